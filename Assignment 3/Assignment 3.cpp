@@ -1,7 +1,16 @@
 #include "utilities.h"
+#include "Benchmark.h"
 #include "Camera.h"
+#include "EnvironmentMap.h"
 #include "SimpleModel.h"
 #include "Texture.h"
+#include "TextureLoader.h"
+#include "TextureRegistry.h"
+#include "TextureResidency.h"
+#include "TextureTelemetry.h"
+#include "TextureUnits.h"
+#include "TextureWatcher.h"
+#include "VirtualTexture.h"
 
 // global variables
 // settings
@@ -13,12 +22,45 @@ const float gCamRotateSensitivity = 0.1f;
 // frame stats
 float gFrameRate = 60.0f;
 float gFrameTime = 1 / gFrameRate;
+int gPendingTextures = 0;			// textures still loading
+float gTimeToFirstFrame = 0.0f;		// until every texture had a mip level resident (ms)
+float gTimeToFullDetail = 0.0f;		// until every texture had its full mip chain resident (ms)
+int gTextureBinds = 0;				// texture binds in the last frame
+int gTextureBindsSkipped = 0;		// redundant texture binds skipped in the last frame
+int gSamplerBinds = 0;				// sampler binds in the last frame
+int gSamplerBindsSkipped = 0;		// redundant sampler binds skipped in the last frame
+int gTrianglesDrawn = 0;			// model triangles drawn in the last frame
+int gFullDetailTriangles = 0;		// model triangles the same draws would have at full detail
+float gTextureMemory = 0.0f;		// estimated texture memory (MB)
+int gEvictedTextures = 0;			// textures reduced to low resolution mips
+float gTextureMemorySaved = 0.0f;	// texture memory saved by sharing (MB)
+int gResidentPages = 0;				// virtual texture pages in the page cache
+int gRequestedPages = 0;			// virtual texture pages requested by feedback
+
+// texture stats, totals over gTextures
+int gTextureCount = 0;				// textures loaded
+float gTextureStatsMemory = 0.0f;	// estimated video memory including mips (MB)
+float gTextureQualitySaved = 0.0f;	// video memory saved by skipping mips at the texture quality (MB)
+float gTextureDecodeTime = 0.0f;	// CPU decoding and compression (ms)
+float gTextureMipTime = 0.0f;		// mip chain generation (ms)
+float gTextureUploadTime = 0.0f;	// GL uploads (ms)
+int gTexturesReloaded = 0;			// textures reloaded after their files changed
+float gLastReloadTime = 0.0f;		// from noticing a file change until its texture was updated (ms)
 
 // scene content
 GLuint gVBO[3];
 GLuint gVAO[3];
 std::map<std::string, ShaderProgram> gShaders; // holds multiple shaders
-std::map<std::string, Texture> gTextures; // holds multiple textures
+std::map<std::string, std::shared_ptr<Texture>> gTextures; // holds multiple textures
+TextureLoader gTextureLoader;				// decodes textures on worker threads
+float gTextureUploadBudget = 2.0f;			// texture upload time per frame (ms)
+TextureRegistry gTextureRegistry(gTextureLoader);	// shares textures with identical contents
+TextureResidency gTextureResidency(gTextureLoader);	// keeps textures within the memory budget
+float gTextureBudget = 256.0f;				// texture memory budget (MB)
+Texture::Quality gTextureQuality = Texture::Quality::Full;	// finest mips skipped when loading file textures
+TextureWatcher gTextureWatcher(gTextureLoader);	// reloads textures when their files change
+VirtualTextureSystem gVirtualTextures;		// streams virtual texture pages
+std::map<std::string, int> gVirtualTextureIDs;	// virtual texture of each material
 std::map <std::string, SimpleModel> gModels; // holds multiple models
 
 Camera gCamera;					// camera object
@@ -37,6 +79,9 @@ bool gMultiViewMode = false;		// multiview toggle control
 float gFloorReflection = 0.5f;		// floor reflective amount
 float gTorusReflection = 1.0f;		// torus reflective amount
 float gTorusRotationSpeed = 1.0f;	// torus rotation speed
+bool gVirtualTexturing = false;		// sample floor and walls through virtual textures
+bool gEnvironmentLighting = true;	// ambient lighting from the environment cube map
+IrradianceSH gIrradiance;			// spherical harmonic irradiance of the environment cube map
 
 // function initialise scene and render settings
 static void init(GLFWwindow* window)
@@ -45,24 +90,53 @@ static void init(GLFWwindow* window)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
 	glEnable(GL_DEPTH_TEST);	// enable depth buffer test
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);	// filter prefiltered cube map levels across face edges
 
 	// compile and link a vertex and fragment shader pair
 	gShaders["Reflection"].compileAndLink("lighting.vert", "reflection.frag");
 	gShaders["NormalMap"].compileAndLink("normalMap.vert", "normalMap.frag");
 	gShaders["CubeMapReflection"].compileAndLink("cubeLighting.vert", "lighting_cubemap.frag");
 	gShaders["Lines"].compileAndLink("modelViewProj.vert", "color.frag");
-
-
-	// load textures
-	gTextures["Stone"].generate("./images/Fieldstone.bmp");
-	gTextures["StoneNormalMap"].generate("./images/FieldstoneBumpDOT3.bmp");
-	gTextures["Floor"].generate("./images/check.bmp");
-	gTextures["Smile"].generate("./images/smile.bmp");
-	gTextures["CubeMap"].generate(
+	gShaders["Feedback"].compileAndLink("lighting.vert", "feedback.frag");
+	gShaders["FeedbackNormalMap"].compileAndLink("normalMap.vert", "feedback.frag");
+
+
+	// load textures asynchronously, placeholders are bound until they are ready
+	// same-sized images share a texture array, materials select a layer
+	// textures are shared through the registry, loading the same files again returns the same texture
+	// and identical contents under another path alias it, files are hashed on worker threads
+	gTextureLoader.start();
+	gTextures["Colour"] = gTextureRegistry.acquireArray({ "./images/check.bmp", "./images/smile.bmp" });
+	gTextures["Stone"] = gTextureRegistry.acquireArray({ "./images/Fieldstone.bmp" });
+	gTextures["Normals"] = gTextureRegistry.acquireArray({ "./images/FieldstoneBumpDOT3.bmp" }, Texture::Type::NormalMap);
+	gTextures["CubeMap"] = std::make_shared<Texture>();
+	gTextures["CubeMap"]->generate(
 		"./images/cm_front.bmp", "./images/cm_back.bmp",
 		"./images/cm_left.bmp", "./images/cm_right.bmp",
 		"./images/cm_top.bmp", "./images/cm_bottom.bmp");
 
+	// diffuse ambient lighting from the unfiltered environment
+	CubeImage environment;
+	if (EnvironmentMap::fromTexture(*gTextures["CubeMap"], environment))
+		EnvironmentMap::projectIrradiance(environment, gIrradiance);
+	else
+		gEnvironmentLighting = false;
+
+	// virtual textures for the floor and walls, streamed in pages from a tiled file
+	// feedback is rendered at an eighth of the window size
+	gVirtualTextures.init(8, gWindowWidth / 8, gWindowHeight / 8, 8);
+	gVirtualTextureIDs["Floor"] = gVirtualTextures.add("./images/check.bmp");
+	gVirtualTextureIDs["Wall"] = gVirtualTextures.add("./images/Fieldstone.bmp");
+
+	// keep texture memory within budget and reload textures when their files are edited
+	// an edited texture stops sharing its old contents with identical files
+	for (auto& texture : gTextures)
+	{
+		gTextureResidency.manage(texture.second);
+		gTextureWatcher.watch(texture.second);
+	}
+	gTextureWatcher.setChangeCallback([](const std::shared_ptr<Texture>& texture) { gTextureRegistry.unshare(texture); });
+
 	// initialise view matrix
 	gCamera.setViewMatrix(glm::vec3(0.0f, 5.0f, 4.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
@@ -91,16 +165,20 @@ static void init(GLFWwindow* window)
 	gMaterial["Floor"].Kd = glm::vec3(1.0f, 1.0f, 1.0f);
 	gMaterial["Floor"].Ks = glm::vec3(1.0f, 1.0f, 1.0f);
 	gMaterial["Floor"].shininess = 40.0f;
+	gMaterial["Floor"].textureLayer = 0;
 
 	gMaterial["Cube"].Ka = glm::vec3(0.2f);
 	gMaterial["Cube"].Kd = glm::vec3(1.0f, 1.0f, 1.0f);
 	gMaterial["Cube"].Ks = glm::vec3(1.0f, 1.0f, 1.0f);
 	gMaterial["Cube"].shininess = 10.0f;
+	gMaterial["Cube"].textureLayer = 1;
 
 	gMaterial["Wall"].Ka = glm::vec3(0.2f);
 	gMaterial["Wall"].Kd = glm::vec3(0.2f, 0.7f, 1.0f);
 	gMaterial["Wall"].Ks = glm::vec3(0.2f, 0.7f, 1.0f);
 	gMaterial["Wall"].shininess = 40.0f;
+	gMaterial["Wall"].textureLayer = 0;
+	gMaterial["Wall"].normalLayer = 0;
 
 	gMaterial["Torus"].Ka = glm::vec3(0.2f);
 	gMaterial["Torus"].Kd = glm::vec3(0.2f, 0.7f, 1.0f);
@@ -113,9 +191,9 @@ static void init(GLFWwindow* window)
 	gModelMatrix["Cube"] = glm::translate(glm::vec3(-0.4f, 0.2f, 0.0f)) * glm::scale(glm::vec3(0.2f, 0.2f, 0.2f));
 	gModelMatrix["Torus"] = glm::mat4(1.0f);
 
-	// load models
-	gModels["Cube"].loadModel("./models/cube.obj", true);
-	gModels["Torus"].loadModel("./models/torus.obj");
+	// load models, quantized to 16-bit positions, normals and texture coordinates
+	gModels["Cube"].loadModel("./models/cube.obj", true, true);
+	gModels["Torus"].loadModel("./models/torus.obj", false, true);
 
 	// vertex positions and normals
 	std::vector<GLfloat> floorVertices =
@@ -276,6 +354,28 @@ static void update_scene(GLFWwindow* window)
 }
 
 
+// set the virtual texture samplers of a shader, sampling through the material's virtual texture if enabled
+// samplers always get their own units so they never share one with a sampler of another type
+static void set_virtual_texture(ShaderProgram* shader, const std::string& material, int tableUnit)
+{
+	auto virtualTexture = gVirtualTextureIDs.find(material);
+	int id = (gVirtualTexturing && virtualTexture != gVirtualTextureIDs.end()) ? virtualTexture->second : 0;
+
+	shader->setUniform("uVirtual", id != 0);
+	shader->setUniform("uPageCache", 3);
+	shader->setUniform("uPageTable", tableUnit);
+
+	if (id != 0)
+		gVirtualTextures.setUniforms(*shader, id, 3, tableUnit);
+}
+
+// set the ambient lighting of a shader, either the light's ambient or irradiance from the environment
+static void set_environment_lighting(ShaderProgram* shader)
+{
+	shader->setUniform("uEnvironmentLighting", gEnvironmentLighting);
+	shader->setUniform("uIrradiance[0]", gIrradiance.coefficients, 9);
+}
+
 void draw_floor(float alpha)
 {
 	ShaderProgram *gShader = &gShaders["Reflection"];
@@ -311,9 +411,11 @@ void draw_floor(float alpha)
 	// set blending amount
 	gShader->setUniform("uAlpha", alpha);
 	
+	// colour array is bound to unit 0 for the frame
 	gShader->setUniform("uTextureSampler", 0);
-	glActiveTexture(GL_TEXTURE0);
-	gTextures["Floor"].bind();
+	gShader->setUniform("uTextureLayer", gMaterial["Floor"].textureLayer);
+	set_virtual_texture(gShader, "Floor", 4);
+	set_environment_lighting(gShader);
 
 	glBindVertexArray(gVAO[0]);				// make VAO active
 
@@ -350,10 +452,14 @@ void draw_objects(bool reflection)
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
 	glm::vec3 lightPosition = gLight.pos;
 
+	// the reflection keeps its own levels of detail, the viewports of each pass are views 0 to 2
+	int view = 0;
+
 	if (reflection)
 	{
 		// create reflection matrix about the horizontal plane
 		reflectMatrix = glm::scale(glm::vec3(1.0f, -1.0f, 1.0f));
+		view = 3;
 
 		// reposition the point light when rendering the reflection
 		lightPosition = glm::vec3(reflectMatrix * glm::vec4(lightPosition, 1.0f));
@@ -395,9 +501,9 @@ void draw_objects(bool reflection)
 	gShader->setUniform("uNormalMatrix", normalMatrix);
 
 	gShader->setUniform("uTextureSampler", 0);
-
-	glActiveTexture(GL_TEXTURE0);
-	gTextures["Smile"].bind();
+	gShader->setUniform("uTextureLayer", gMaterial["Cube"].textureLayer);
+	set_virtual_texture(gShader, "Cube", 4);
+	set_environment_lighting(gShader);
 
 
 
@@ -406,25 +512,25 @@ void draw_objects(bool reflection)
 		/* Bottom Right Viewport - Camera */
 		glViewport(600, 0, 600, 500); // sets view port
 		// draw model
-		gModels["Cube"].drawModel();
+		gModels["Cube"].drawModel(gModels["Cube"].projectedSize(MVP, 500.0f), view);
 
 		/* Bottom Left Viewport - Front */
 		glViewport(0, 0, 600, 500); // sets view port
 		MVP = gProjectionMatrix["Main"] * gViewMatrix["Front"] * modelMatrix; // calculates MVP
 		gShader->setUniform("uModelViewProjectionMatrix", MVP); // sets updated MVP
 		// draw model
-		gModels["Cube"].drawModel();
+		gModels["Cube"].drawModel(gModels["Cube"].projectedSize(MVP, 500.0f), view + 1);
 
 		/* Top Right Viewport - Top */
 		glViewport(600, 500, 600, 500); // sets view port
 		MVP = gProjectionMatrix["Main"] * gViewMatrix["Top"] * modelMatrix; // calculates MVP
 		gShader->setUniform("uModelViewProjectionMatrix", MVP); // sets updated MVP
 		// draw model
-		gModels["Cube"].drawModel();
+		gModels["Cube"].drawModel(gModels["Cube"].projectedSize(MVP, 500.0f), view + 2);
 	}
 	else {
 		// draw model
-		gModels["Cube"].drawModel();
+		gModels["Cube"].drawModel(gModels["Cube"].projectedSize(MVP, static_cast<float>(gWindowHeight)), view);
 	}
 
 
@@ -452,13 +558,13 @@ void draw_objects(bool reflection)
 	gShader->setUniform("uMaterial.Ks", gMaterial["Wall"].Ks);
 	gShader->setUniform("uMaterial.shininess", gMaterial["Wall"].shininess);
 
-	// set textures
-	gShader->setUniform("uTextureSampler", 0);
-	gShader->setUniform("uNormalSampler", 1);
-	glActiveTexture(GL_TEXTURE0);
-	gTextures["Stone"].bind();
-	glActiveTexture(GL_TEXTURE1);
-	gTextures["StoneNormalMap"].bind();
+	// set textures, colour is a layer of the stone array on unit 1, the normal map is gTextures["Normals"] on unit 6
+	gShader->setUniform("uTextureSampler", 1);
+	gShader->setUniform("uNormalSampler", 6);
+	gShader->setUniform("uTextureLayer", gMaterial["Wall"].textureLayer);
+	gShader->setUniform("uNormalLayer", gMaterial["Wall"].normalLayer);
+	set_virtual_texture(gShader, "Wall", 5);
+	set_environment_lighting(gShader);
 
 	// set viewing position
 	gShader->setUniform("uViewpoint", gCamera.getPosition());
@@ -542,36 +648,37 @@ void draw_objects(bool reflection)
 	gShader->setUniform("uModelMatrix", modelMatrix);
 	gShader->setUniform("uNormalMatrix", normalMatrix);
 	gShader->setUniform("uReflection", gTorusReflection);
+	set_environment_lighting(gShader);
 
 	// set textures
-	gShader->setUniform("uEnvironmentMap", 0);
-	glActiveTexture(GL_TEXTURE0);
-	gTextures["CubeMap"].bind();
+	gShader->setUniform("uEnvironmentMap", 2);
+	gShader->setUniform("uEnvironmentLod",
+		EnvironmentMap::shininessToLod(gMaterial["Torus"].shininess, gTextures["CubeMap"]->getLevelCount()));
 
 	// checks for multiview mode
 	if (gMultiViewMode) {
 		/* Bottom Right Viewport - Camera */
 		glViewport(600, 0, 600, 500); // sets view port
 		// draw model
-		gModels["Torus"].drawModel();
+		gModels["Torus"].drawModel(gModels["Torus"].projectedSize(MVP, 500.0f), view);
 
 		/* Bottom Left Viewport - Front */
 		glViewport(0, 0, 600, 500); // sets view port
 		MVP = gProjectionMatrix["Main"] * gViewMatrix["Front"] * modelMatrix; // calculates MVP
 		gShader->setUniform("uModelViewProjectionMatrix", MVP); // sets updated MVP
 		// draw model
-		gModels["Torus"].drawModel();
+		gModels["Torus"].drawModel(gModels["Torus"].projectedSize(MVP, 500.0f), view + 1);
 
 		/* Top Right Viewport - Top */
 		glViewport(600, 500, 600, 500); // sets view port
 		MVP = gProjectionMatrix["Main"] * gViewMatrix["Top"] * modelMatrix; // calculates MVP
 		gShader->setUniform("uModelViewProjectionMatrix", MVP); // sets updated MVP
 		// draw model
-		gModels["Torus"].drawModel();
+		gModels["Torus"].drawModel(gModels["Torus"].projectedSize(MVP, 500.0f), view + 2);
 	}
 	else {
 		// draw model
-		gModels["Torus"].drawModel();
+		gModels["Torus"].drawModel(gModels["Torus"].projectedSize(MVP, static_cast<float>(gWindowHeight)), view);
 	}
 
 	
@@ -581,6 +688,45 @@ void draw_objects(bool reflection)
 
 }
 
+// render the virtual texture feedback pass for the floor and walls
+static void draw_feedback()
+{
+	gVirtualTextures.beginFeedback();
+
+	glm::mat4 viewProjection = gCamera.getProjMatrix() * gCamera.getViewMatrix();
+
+	// floor
+	if (gVirtualTextureIDs["Floor"] != 0)
+	{
+		ShaderProgram* gShader = &gShaders["Feedback"];
+		gShader->use();
+		gShader->setUniform("uModelViewProjectionMatrix", viewProjection * gModelMatrix["Floor"]);
+		gVirtualTextures.setFeedbackUniforms(*gShader, gVirtualTextureIDs["Floor"]);
+
+		glBindVertexArray(gVAO[0]);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	// walls
+	if (gVirtualTextureIDs["Wall"] != 0)
+	{
+		ShaderProgram* gShader = &gShaders["FeedbackNormalMap"];
+		gShader->use();
+		gVirtualTextures.setFeedbackUniforms(*gShader, gVirtualTextureIDs["Wall"]);
+
+		glBindVertexArray(gVAO[1]);
+		glm::mat4 wallMatrix = glm::mat4(1.0f);
+		for (int i = 0; i < 4; i++) {
+			gShader->setUniform("uModelViewProjectionMatrix", viewProjection * wallMatrix);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+			wallMatrix *= glm::rotate(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // rotates wall matrix
+		}
+	}
+
+	gVirtualTextures.endFeedback();
+}
+
 // function to render the scene
 static void render_scene()
 {
@@ -588,11 +734,29 @@ static void render_scene()
 	// Default view port
 	glViewport(0, 0, gWindowWidth, gWindowHeight);
 
+	// write the virtual texture pages this frame needs
+	if (gVirtualTexturing)
+		draw_feedback();
+
 	/************************************************************************************
 	 * Clear colour buffer, depth buffer and stencil buffer
 	 ************************************************************************************/
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
+	// bind textures once for every pass of the frame
+	gTextures["Colour"]->bind(0);
+	gTextures["Stone"]->bind(1);
+	gTextures["Normals"]->bind(6);
+	gTextures["CubeMap"]->bind(2);
+	if (gVirtualTexturing)
+	{
+		gVirtualTextures.bindPageCache(3);
+		if (gVirtualTextureIDs["Floor"] != 0)
+			gVirtualTextures.bindPageTable(gVirtualTextureIDs["Floor"], 4);
+		if (gVirtualTextureIDs["Wall"] != 0)
+			gVirtualTextures.bindPageTable(gVirtualTextureIDs["Wall"], 5);
+	}
+
 	// ******** START DRAW MULTIVIEW LINES ********
 	// draws lines only if multiview is true
 	if (gMultiViewMode) {
@@ -665,6 +829,18 @@ static void render_scene()
 	glFlush();
 }
 
+// run texture processing benchmarks, results are printed to the console
+static void run_benchmarks()
+{
+	Benchmark::mipGeneration({ "./images/Fieldstone.bmp", "./images/Tile4.bmp" });
+	Benchmark::environmentPrefilter({ "./images/cm_right.bmp", "./images/cm_left.bmp", "./images/cm_top.bmp",
+		"./images/cm_bottom.bmp", "./images/cm_back.bmp", "./images/cm_front.bmp" });
+	Benchmark::panoramaConversion();
+	// the diffuse images stand in for height maps of the same size
+	Benchmark::heightMapNormals({ "./images/Fieldstone.bmp", "./images/Tile4.bmp" },
+		{ "./images/FieldstoneBumpDOT3.bmp", "./images/Tile4BumpDOT3.bmp" });
+}
+
 // key press or release callback function
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
@@ -676,6 +852,11 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 		return;
 	}
 
+	// run benchmarks when B is pressed
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		run_benchmarks();
+	}
+
 	// increases camera move speed while left shift is held
 	if (key == GLFW_KEY_LEFT_SHIFT && action == GLFW_PRESS) {
 		gCamMoveSensitivity = 3.0f;
@@ -729,6 +910,25 @@ static void mouse_button_callback(GLFWwindow* window, int button, int action, in
 	TwEventMouseButtonGLFW(button, action);
 }
 
+// framebuffer resize callback function
+static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	// nothing to resize while minimised
+	if (width <= 0 || height <= 0)
+		return;
+
+	gWindowWidth = width;
+	gWindowHeight = height;
+
+	// keep the camera aspect ratio and the tweak bar in step with the window
+	gCamera.setProjMatrix(glm::perspective(glm::radians(45.0f),
+		static_cast<float>(gWindowWidth) / gWindowHeight, 0.1f, 15.0f));
+	TwWindowSize(gWindowWidth, gWindowHeight);
+
+	// feedback stays at an eighth of the window size
+	gVirtualTextures.resize(gWindowWidth / 8, gWindowHeight / 8);
+}
+
 // error callback function
 static void error_callback(int error, const char* description)
 {
@@ -751,11 +951,46 @@ TwBar* create_UI(const std::string name)
 	// create frame stat entries
 	TwAddVarRO(twBar, "Frame Rate", TW_TYPE_FLOAT, &gFrameRate, " group='Frame Stats' precision=2 ");
 	TwAddVarRO(twBar, "Frame Time", TW_TYPE_FLOAT, &gFrameTime, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Textures Loading", TW_TYPE_INT32, &gPendingTextures, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Time To First Frame (ms)", TW_TYPE_FLOAT, &gTimeToFirstFrame, " group='Frame Stats' precision=1 ");
+	TwAddVarRO(twBar, "Time To Full Detail (ms)", TW_TYPE_FLOAT, &gTimeToFullDetail, " group='Frame Stats' precision=1 ");
+	TwAddVarRO(twBar, "Texture Binds", TW_TYPE_INT32, &gTextureBinds, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Texture Binds Skipped", TW_TYPE_INT32, &gTextureBindsSkipped, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Sampler Binds", TW_TYPE_INT32, &gSamplerBinds, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Sampler Binds Skipped", TW_TYPE_INT32, &gSamplerBindsSkipped, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Triangles Drawn", TW_TYPE_INT32, &gTrianglesDrawn, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Full Detail Triangles", TW_TYPE_INT32, &gFullDetailTriangles, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Texture Memory (MB)", TW_TYPE_FLOAT, &gTextureMemory, " group='Frame Stats' precision=2 ");
+	TwAddVarRO(twBar, "Evicted Textures", TW_TYPE_INT32, &gEvictedTextures, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Shared Memory Saved (MB)", TW_TYPE_FLOAT, &gTextureMemorySaved, " group='Frame Stats' precision=2 ");
+	TwAddVarRO(twBar, "Resident Pages", TW_TYPE_INT32, &gResidentPages, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Requested Pages", TW_TYPE_INT32, &gRequestedPages, " group='Frame Stats' ");
+
+	TwAddVarRO(twBar, "Texture Count", TW_TYPE_INT32, &gTextureCount, " group='Texture Stats' ");
+	TwAddVarRO(twBar, "Estimated Memory (MB)", TW_TYPE_FLOAT, &gTextureStatsMemory, " group='Texture Stats' precision=2 ");
+	TwAddVarRO(twBar, "Quality Saved (MB)", TW_TYPE_FLOAT, &gTextureQualitySaved, " group='Texture Stats' precision=2 ");
+	TwAddVarRO(twBar, "Decode Time (ms)", TW_TYPE_FLOAT, &gTextureDecodeTime, " group='Texture Stats' precision=1 ");
+	TwAddVarRO(twBar, "Mip Time (ms)", TW_TYPE_FLOAT, &gTextureMipTime, " group='Texture Stats' precision=1 ");
+	TwAddVarRO(twBar, "Upload Time (ms)", TW_TYPE_FLOAT, &gTextureUploadTime, " group='Texture Stats' precision=1 ");
+	TwAddVarRO(twBar, "Textures Reloaded", TW_TYPE_INT32, &gTexturesReloaded, " group='Texture Stats' ");
+	TwAddVarRO(twBar, "Last Reload (ms)", TW_TYPE_FLOAT, &gLastReloadTime, " group='Texture Stats' precision=1 ");
 
 	
 	// scene controls
 	TwAddVarRW(twBar, "Wireframe", TW_TYPE_BOOLCPP, &gWireframe, " group='Controls' ");
 	TwAddVarRW(twBar, "Multiview Mode", TW_TYPE_BOOLCPP, &gMultiViewMode, " group='Controls' ");
+	TwAddVarRW(twBar, "Virtual Texturing", TW_TYPE_BOOLCPP, &gVirtualTexturing, " group='Controls' ");
+	TwAddVarRW(twBar, "Environment Lighting", TW_TYPE_BOOLCPP, &gEnvironmentLighting, " group='Controls' ");
+	TwAddVarRW(twBar, "Texture Budget (MB)", TW_TYPE_FLOAT, &gTextureBudget, " group='Controls' min=0 max=1024 step=0.25 ");
+
+	// texture quality tiers
+	TwEnumVal qualities[] = {
+		{ static_cast<int>(Texture::Quality::Full), "Full" },
+		{ static_cast<int>(Texture::Quality::Half), "Half" },
+		{ static_cast<int>(Texture::Quality::Quarter), "Quarter" }
+	};
+	TwType qualityType = TwDefineEnum("TextureQuality", qualities, 3);
+	TwAddVarRW(twBar, "Texture Quality", qualityType, &gTextureQuality, " group='Controls' ");
 
 	// light control
 	TwAddVarRW(twBar, "Position X", TW_TYPE_FLOAT, &gLight.pos.x, " group='Light' min=-3 max=3 step=0.01 ");
@@ -816,6 +1051,7 @@ int main(void)
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetCursorPosCallback(window, cursor_position_callback);
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
 	// initialise scene and render settings
 	init(window);
@@ -834,16 +1070,70 @@ int main(void)
 	{
 		update_scene(window);	// update the scene
 
+		// queue reloads of edited image files, they are decoded on the loader's worker threads
+		gTextureWatcher.update();
+		gTexturesReloaded = gTextureWatcher.getReloadCount();
+		gLastReloadTime = static_cast<float>(gTextureWatcher.getLastReloadMs());
+
+		// share or queue textures whose files finished hashing
+		gTextureRegistry.update();
+
+		// upload textures that finished decoding and stream finer mip levels, within the frame budget
+		gTextureLoader.update(gTextureUploadBudget);
+		gPendingTextures = gTextureLoader.getPendingCount();
+		gTimeToFirstFrame = static_cast<float>(gTextureLoader.getTimeToFirstFrame());
+		gTimeToFullDetail = static_cast<float>(gTextureLoader.getTimeToFullDetail());
+
+		// stream virtual texture pages requested by earlier feedback passes
+		if (gVirtualTexturing)
+		{
+			gVirtualTextures.update(8);
+			gResidentPages = gVirtualTextures.getResidentPages();
+			gRequestedPages = gVirtualTextures.getRequestedPages();
+		}
+
 		// if wireframe set polygon render mode to wireframe
 		if (gWireframe)
 			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+		TextureUnits::resetCounts();
+		SimpleModel::resetCounts();
 		render_scene();			// render the scene
+		gTrianglesDrawn = SimpleModel::getTrianglesDrawn();
+		gFullDetailTriangles = SimpleModel::getFullDetailTriangles();
+		gTextureBinds = TextureUnits::getTextureBinds();
+		gTextureBindsSkipped = TextureUnits::getTextureBindsSkipped();
+		gSamplerBinds = TextureUnits::getSamplerBinds();
+		gSamplerBindsSkipped = TextureUnits::getSamplerBindsSkipped();
+
+		// reload file textures when the quality changes, their current levels stay bound until the new ones arrive
+		if (gTextureQuality != Texture::getQuality())
+		{
+			Texture::setQuality(gTextureQuality);
+			gTextureResidency.reloadAll();
+		}
+
+		// evict least recently used textures over budget, reload evicted textures that were bound
+		gTextureResidency.setBudget(static_cast<size_t>(gTextureBudget * 1024.0f * 1024.0f));
+		gTextureResidency.update();
+		gTextureMemory = gTextureResidency.getResidentBytes() / (1024.0f * 1024.0f);
+		gEvictedTextures = gTextureResidency.getEvictedCount();
+		gTextureMemorySaved = gTextureRegistry.getSavedBytes() / (1024.0f * 1024.0f);
+		Texture::nextFrame();
+
+		TextureTelemetry::Totals textureTotals = TextureTelemetry::total(gTextures);
+		gTextureCount = textureTotals.textures;
+		gTextureStatsMemory = textureTotals.bytes / (1024.0f * 1024.0f);
+		gTextureQualitySaved = textureTotals.skippedBytes / (1024.0f * 1024.0f);
+		gTextureDecodeTime = static_cast<float>(textureTotals.decodeMs);
+		gTextureMipTime = static_cast<float>(textureTotals.mipMs);
+		gTextureUploadTime = static_cast<float>(textureTotals.uploadMs);
 
 		// set polygon render mode to fill
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 		TwDraw();				// draw tweak bar
+		TextureUnits::invalidate();	// the tweak bar binds its own textures
 
 		glfwSwapBuffers(window);	// swap buffers
 		glfwPollEvents();			// poll for events
@@ -861,6 +1151,9 @@ int main(void)
 		}
 	}
 
+	// write texture stats for sizing texture budgets
+	TextureTelemetry::dump("texture_stats.json", gTextures);
+
 	// clean up
 	glDeleteBuffers(3, gVBO);
 	glDeleteVertexArrays(3, gVAO);
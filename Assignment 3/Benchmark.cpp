@@ -0,0 +1,322 @@
+#include "Benchmark.h"
+#include "MipGenerator.h"
+#include "EnvironmentMap.h"
+#include "HeightMap.h"
+#include "Parallel.h"
+#include "Texture.h"
+#include "TextureUnits.h"
+#include "Timing.h"
+#include "utilities.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <future>
+#include <iomanip>
+
+namespace
+{
+	// upload a full mip chain to the bound texture
+	void uploadLevels(const std::vector<TextureLevel>& levels)
+	{
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA8, levels[i].width, levels[i].height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, levels[i].data.data());
+		}
+	}
+
+	// resample a cube to another face size, nearest texel
+	void resizeCube(const CubeImage& source, int size, CubeImage& result)
+	{
+		result.size = size;
+		for (int face = 0; face < 6; face++)
+		{
+			result.faces[face].resize(static_cast<size_t>(size) * size * 4);
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					const float* in = source.texel(face, x * source.size / size, y * source.size / size);
+					std::copy(in, in + 4, result.texel(face, x, y));
+				}
+			}
+		}
+	}
+
+	// decoded RGBA8 source image
+	struct SourceImage
+	{
+		std::string filename;
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> pixels;
+	};
+}
+
+void Benchmark::mipGeneration(const std::vector<std::string>& filenames, int iterations)
+{
+	// decode the sources once, decoding is not part of the measurement
+	std::vector<SourceImage> images;
+	for (const std::string& filename : filenames)
+	{
+		SourceImage image;
+		int channels;
+		unsigned char* pixels = stbi_load(filename.c_str(), &image.width, &image.height, &channels, 4);
+
+		if (!pixels)
+		{
+			std::cout << "Unable to load: " << filename << std::endl;
+			continue;
+		}
+
+		image.filename = filename;
+		image.pixels.assign(pixels, pixels + image.width * image.height * 4);
+		stbi_image_free(pixels);
+		images.push_back(std::move(image));
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, texture);
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Mip generation benchmark (" << iterations << " iterations, ms per image)" << std::endl;
+
+	for (const SourceImage& image : images)
+	{
+		// driver path: upload the base level and let the driver build the chain
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		glFinish();
+		double driverMs = Timing::elapsedMs(start) / iterations;
+
+		// CPU paths: generate the chain, then upload level by level
+		double cpuMs[2];
+		MipFilter filters[2] = { MipFilter::Box, MipFilter::Lanczos };
+
+		for (int f = 0; f < 2; f++)
+		{
+			std::vector<TextureLevel> levels;
+			glFinish();
+			start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				MipGenerator::generate(image.pixels.data(), image.width, image.height, filters[f], true, levels);
+				uploadLevels(levels);
+			}
+			glFinish();
+			cpuMs[f] = Timing::elapsedMs(start) / iterations;
+		}
+
+		std::cout << "  " << image.filename << " (" << image.width << "x" << image.height << ")"
+			<< "  glGenerateMipmap: " << driverMs
+			<< "  CPU box (sRGB): " << cpuMs[0]
+			<< "  CPU Lanczos (sRGB): " << cpuMs[1] << std::endl;
+	}
+
+	// all images generated concurrently, as the texture loader does
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		std::vector<std::future<void>> futures;
+		for (const SourceImage& image : images)
+		{
+			futures.push_back(std::async(std::launch::async, [&image]()
+			{
+				std::vector<TextureLevel> levels;
+				MipGenerator::generate(image.pixels.data(), image.width, image.height, MipFilter::Box, true, levels);
+			}));
+		}
+		for (std::future<void>& future : futures)
+		{
+			future.get();
+		}
+	}
+	std::cout << "  all images in parallel, CPU box (no upload): " << Timing::elapsedMs(start) / iterations << std::endl;
+
+	TextureUnits::forgetTexture(texture);
+	glDeleteTextures(1, &texture);
+}
+
+void Benchmark::environmentPrefilter(const std::vector<std::string>& faceFiles, int iterations)
+{
+	if (faceFiles.size() != 6)
+		return;
+
+	// decode the faces once, decoding is not part of the measurement
+	std::vector<unsigned char> pixels[6];
+	const unsigned char* faces[6];
+	int size = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		int width, height, channels;
+		unsigned char* data = stbi_load(faceFiles[i].c_str(), &width, &height, &channels, 4);
+
+		if (!data || width != height || (size != 0 && width != size))
+		{
+			std::cout << "Unable to load cubemap image: " << faceFiles[i] << std::endl;
+			stbi_image_free(data);
+			return;
+		}
+
+		size = width;
+		pixels[i].assign(data, data + width * height * 4);
+		faces[i] = pixels[i].data();
+		stbi_image_free(data);
+	}
+
+	CubeImage source;
+	EnvironmentMap::fromImages(faces, size, 4, source);
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Environment prefilter benchmark (" << iterations << " iterations, ms per cube map)" << std::endl;
+
+	const int sizes[] = { 32, 64, 128, 256 };
+	for (int faceSize : sizes)
+	{
+		CubeImage cube;
+		resizeCube(source, faceSize, cube);
+
+		double ms[2];
+		int threads[2] = { 1, Parallel::threadCount() };
+		for (int t = 0; t < 2; t++)
+		{
+			std::vector<TextureLevel> levels;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				EnvironmentMap::prefilter(cube, levels, threads[t]);
+			}
+			ms[t] = Timing::elapsedMs(start) / iterations;
+		}
+
+		std::cout << "  " << faceSize << "x" << faceSize << " faces"
+			<< "  1 thread: " << ms[0]
+			<< "  " << threads[1] << " threads: " << ms[1] << std::endl;
+	}
+}
+
+void Benchmark::panoramaConversion(int iterations)
+{
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Panorama conversion benchmark (" << iterations << " iterations, ms per cube map)" << std::endl;
+
+	const int widths[] = { 1024, 2048, 4096 };
+	for (int width : widths)
+	{
+		// a smooth colour gradient with a checker, so every texel differs
+		int height = width / 2;
+		std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				unsigned char* texel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+				texel[0] = static_cast<unsigned char>(x * 255 / width);
+				texel[1] = static_cast<unsigned char>(y * 255 / height);
+				texel[2] = ((x / 64 + y / 64) & 1) ? 255 : 0;
+			}
+		}
+
+		int size = EnvironmentMap::panoramaFaceSize(width);
+		double ms[2];
+		int threads[2] = { 1, Parallel::threadCount() };
+		for (int t = 0; t < 2; t++)
+		{
+			CubeImage cube;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				EnvironmentMap::fromPanorama(pixels.data(), width, height, 3, size, cube, threads[t]);
+			}
+			ms[t] = Timing::elapsedMs(start) / iterations;
+		}
+
+		// the whole uncached path of Texture::generatePanorama, from the file contents to the
+		// prefiltered and compressed chain, the panorama is wrapped in a binary PPM header so no file is needed
+		std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		std::vector<unsigned char> fileData(header.begin(), header.end());
+		fileData.insert(fileData.end(), pixels.begin(), pixels.end());
+
+		double totalMs = 0.0;
+		double mipMs = 0.0;
+		for (int i = 0; i < iterations; i++)
+		{
+			TextureData data;
+			auto start = std::chrono::steady_clock::now();
+			Texture::decodePanorama(fileData, Texture::useCompression(), data);
+			totalMs += Timing::elapsedMs(start);
+			mipMs += data.mipMs;
+		}
+
+		std::cout << "  " << width << "x" << height << " to " << size << "x" << size << " faces"
+			<< "  resample 1 thread: " << ms[0]
+			<< "  " << threads[1] << " threads: " << ms[1]
+			<< "  decode and prefilter: " << totalMs / iterations
+			<< " (prefilter " << mipMs / iterations << ")" << std::endl;
+	}
+}
+
+void Benchmark::heightMapNormals(const std::vector<std::string>& heightFiles, const std::vector<std::string>& normalFiles,
+	int iterations)
+{
+	std::cout << "Height map normals benchmark (" << iterations << " iterations, ms per image)" << std::endl;
+
+	for (size_t f = 0; f < heightFiles.size() && f < normalFiles.size(); f++)
+	{
+		int width, height, channels;
+		unsigned char* heights = stbi_load(heightFiles[f].c_str(), &width, &height, &channels, 1);
+
+		if (!heights)
+		{
+			std::cout << "Unable to load: " << heightFiles[f] << std::endl;
+			continue;
+		}
+
+		// Sobel filter on one thread and on all
+		double sobelMs[2];
+		int threads[2] = { 1, Parallel::threadCount() };
+		for (int t = 0; t < 2; t++)
+		{
+			std::vector<unsigned char> normals;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+			{
+				HeightMap::toNormalMap(heights, width, height, HeightMap::cDefaultStrength, normals, threads[t]);
+			}
+			sobelMs[t] = Timing::elapsedMs(start) / iterations;
+		}
+		stbi_image_free(heights);
+
+		// the full uncompressed load of the height map as a normal map, reading, decoding, Sobel, mips and packing
+		TextureData data;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			Texture::decode(heightFiles[f], false, data, Texture::Type::HeightMap);
+		}
+		double heightMapMs = Timing::elapsedMs(start) / iterations;
+
+		// the same load of the shipped normal map
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			Texture::decode(normalFiles[f], false, data, Texture::Type::NormalMap);
+		}
+		double normalMapMs = Timing::elapsedMs(start) / iterations;
+
+		size_t pixels = static_cast<size_t>(width) * height;
+		std::cout << "  " << heightFiles[f] << " (" << width << "x" << height << ")"
+			<< "  Sobel 1 thread: " << sobelMs[0]
+			<< "  " << threads[1] << " threads: " << sobelMs[1]
+			<< "  height map load: " << heightMapMs
+			<< "  normal map load: " << normalMapMs
+			<< "  pixel data " << pixels / 1024 << " KB vs " << pixels * 3 / 1024 << " KB" << std::endl;
+	}
+}
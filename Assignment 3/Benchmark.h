@@ -0,0 +1,28 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/*****************************************************************
+ * timing comparisons for texture processing paths
+ * results are printed to the console, a GL context must be current
+ *****************************************************************/
+namespace Benchmark
+{
+	// compare CPU mip generation against the driver's glGenerateMipmap
+	void mipGeneration(const std::vector<std::string>& filenames, int iterations = 10);
+	// time the specular prefilter of a cube map resampled to several face sizes, on one thread and on all
+	// faceFiles are in OpenGL face order: +X, -X, +Y, -Y, +Z, -Z
+	void environmentPrefilter(const std::vector<std::string>& faceFiles, int iterations = 3);
+	// time equirectangular panorama to cube map resampling at several sizes, on one thread and on all,
+	// and the whole uncached path from file contents to the prefiltered chain on all threads
+	// panoramas are generated so no large image files are needed
+	void panoramaConversion(int iterations = 5);
+	// time deriving normal maps from height maps against decoding the shipped normal maps
+	// heightFiles are read as 8-bit luminance, normalFiles are the matching normal maps
+	void heightMapNormals(const std::vector<std::string>& heightFiles, const std::vector<std::string>& normalFiles,
+		int iterations = 10);
+}
+
+#endif
@@ -0,0 +1,717 @@
+#include "EnvironmentMap.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// weight below which a lobe is cut off, relative to its peak
+	const float cLobeCutoff = 1.0e-3f;
+	// tiles per face edge used to cull source texels outside a lobe, and the texels per edge
+	// of the smaller tiles they are split into
+	const int cTilesPerEdge = 8;
+	const int cSubTileSize = 8;
+
+	// lookup table for sRGB to linear conversion
+	struct LinearTable
+	{
+		float values[256];
+
+		LinearTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				values[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	const float* toLinear()
+	{
+		static const LinearTable table;
+		return table.values;
+	}
+
+	unsigned char toSRGB(float l)
+	{
+		l = std::min(1.0f, std::max(0.0f, l));
+		float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+		return static_cast<unsigned char>(c * 255.0f + 0.5f);
+	}
+
+	// normalised direction through a point on a face, s and t in [-1, 1]
+	void faceDirection(int face, float s, float t, float dir[3])
+	{
+		switch (face)
+		{
+		case 0: dir[0] = 1.0f; dir[1] = -t; dir[2] = -s; break;
+		case 1: dir[0] = -1.0f; dir[1] = -t; dir[2] = s; break;
+		case 2: dir[0] = s; dir[1] = 1.0f; dir[2] = t; break;
+		case 3: dir[0] = s; dir[1] = -1.0f; dir[2] = -t; break;
+		case 4: dir[0] = s; dir[1] = -t; dir[2] = 1.0f; break;
+		default: dir[0] = -s; dir[1] = -t; dir[2] = -1.0f; break;
+		}
+
+		float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		dir[0] /= length;
+		dir[1] /= length;
+		dir[2] /= length;
+	}
+
+	// face coordinate of a texel edge or centre
+	float faceCoord(float x, int size)
+	{
+		return 2.0f * x / size - 1.0f;
+	}
+
+	// solid angle of a texel, from the area of its projection onto the unit sphere
+	float areaElement(float x, float y)
+	{
+		return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+	}
+
+	float texelSolidAngle(int x, int y, int size)
+	{
+		float x0 = faceCoord(static_cast<float>(x), size);
+		float y0 = faceCoord(static_cast<float>(y), size);
+		float x1 = faceCoord(static_cast<float>(x + 1), size);
+		float y1 = faceCoord(static_cast<float>(y + 1), size);
+		return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+	}
+
+	// a block of source texels, culled as a whole against a lobe
+	struct Tile
+	{
+		float dir[3];			// direction through the centre
+		float cosLimit;			// texels are outside the lobe if the lobe axis is further than this from dir
+		int face, x0, y0, x1, y1;
+		std::vector<Tile> children;
+
+		Tile(int face, int x0, int y0, int x1, int y1, int size, float cutoffAngle) :
+			face(face), x0(x0), y0(y0), x1(x1), y1(y1)
+		{
+			faceDirection(face, faceCoord(0.5f * (x0 + x1), size), faceCoord(0.5f * (y0 + y1), size), dir);
+
+			// largest angle between the centre and a corner
+			float radius = 0.0f;
+			for (int corner = 0; corner < 4; corner++)
+			{
+				float cornerDir[3];
+				faceDirection(face, faceCoord(static_cast<float>((corner & 1) ? x1 : x0), size),
+					faceCoord(static_cast<float>((corner & 2) ? y1 : y0), size), cornerDir);
+				float d = dir[0] * cornerDir[0] + dir[1] * cornerDir[1] + dir[2] * cornerDir[2];
+				radius = std::max(radius, std::acos(std::min(1.0f, d)));
+			}
+			cosLimit = std::cos(std::min(3.14159265f, cutoffAngle + radius));
+		}
+	};
+
+	// source texels of one level with their directions and solid angles
+	struct SourceLevel
+	{
+		int size = 0;
+		std::vector<float> texels[6];	// x, y, z, solid angle, r, g, b, unused
+		std::vector<Tile> tiles;
+
+		// cutoffAngle is the angle from the lobe axis beyond which texels are ignored
+		void build(const CubeImage& cube, float cutoffAngle)
+		{
+			size = cube.size;
+			for (int face = 0; face < 6; face++)
+			{
+				texels[face].resize(static_cast<size_t>(size) * size * 8);
+				for (int y = 0; y < size; y++)
+				{
+					for (int x = 0; x < size; x++)
+					{
+						float* out = &texels[face][(static_cast<size_t>(y) * size + x) * 8];
+						faceDirection(face, faceCoord(x + 0.5f, size), faceCoord(y + 0.5f, size), out);
+						out[3] = texelSolidAngle(x, y, size);
+
+						const float* colour = cube.texel(face, x, y);
+						out[4] = colour[0];
+						out[5] = colour[1];
+						out[6] = colour[2];
+						out[7] = 0.0f;
+					}
+				}
+
+				// split the face into tiles, and large tiles into smaller ones
+				int tileSize = std::max(1, size / cTilesPerEdge);
+				for (int y0 = 0; y0 < size; y0 += tileSize)
+				{
+					for (int x0 = 0; x0 < size; x0 += tileSize)
+					{
+						Tile tile(face, x0, y0, std::min(size, x0 + tileSize), std::min(size, y0 + tileSize), size, cutoffAngle);
+
+						if (tileSize > cSubTileSize)
+						{
+							for (int sy = tile.y0; sy < tile.y1; sy += cSubTileSize)
+							{
+								for (int sx = tile.x0; sx < tile.x1; sx += cSubTileSize)
+								{
+									tile.children.emplace_back(face, sx, sy, std::min(tile.x1, sx + cSubTileSize),
+										std::min(tile.y1, sy + cSubTileSize), size, cutoffAngle);
+								}
+							}
+						}
+						tiles.push_back(std::move(tile));
+					}
+				}
+			}
+		}
+	};
+
+	// Phong lobe weighted sum of the texels of a tile
+	void accumulate(const SourceLevel& source, const Tile& tile, const float n[3], float power, float cosCutoff,
+		float sum[4])
+	{
+		const std::vector<float>& texels = source.texels[tile.face];
+		for (int ty = tile.y0; ty < tile.y1; ty++)
+		{
+			const float* texel = &texels[(static_cast<size_t>(ty) * source.size + tile.x0) * 8];
+			for (int tx = tile.x0; tx < tile.x1; tx++, texel += 8)
+			{
+				float cosAngle = n[0] * texel[0] + n[1] * texel[1] + n[2] * texel[2];
+				if (cosAngle <= cosCutoff)
+					continue;
+
+				float weight = std::exp2(power * std::log2(cosAngle)) * texel[3];
+				sum[0] += texel[4] * weight;
+				sum[1] += texel[5] * weight;
+				sum[2] += texel[6] * weight;
+				sum[3] += weight;
+			}
+		}
+	}
+
+	// axes of each face in OpenGL order, the direction through (s, t) is s * sAxis + t * tAxis + normal
+	const float cFaceAxes[6][3][3] =
+	{
+		{ { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+		{ { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }
+	};
+
+	// real spherical harmonic basis constants for bands 0 to 2
+	const float cSH0 = 0.282095f;
+	const float cSH1 = 0.488603f;
+	const float cSH2 = 1.092548f;
+	const float cSH20 = 0.315392f;
+	const float cSH22 = 0.546274f;
+
+	// weighted sums of one face, the nine coefficients for r, g and b followed by the total weight
+	struct ProjectionSums
+	{
+		double values[9][3] = {};
+		double weight = 0.0;
+	};
+
+	// project texels [begin, width) of a row, one texel at a time
+	void projectRowGeneric(const float* row, int width, int face, float t, int begin, ProjectionSums& sums)
+	{
+		const float (*axes)[3] = cFaceAxes[face];
+
+		for (int x = begin; x < width; x++)
+		{
+			float s = faceCoord(x + 0.5f, width);
+
+			// differential solid angle of the texel, dw = area / (1 + s^2 + t^2)^(3/2)
+			float lengthSq = 1.0f + s * s + t * t;
+			float invLength = 1.0f / std::sqrt(lengthSq);
+			float weight = invLength / lengthSq;
+
+			float dir[3];
+			for (int i = 0; i < 3; i++)
+				dir[i] = (s * axes[0][i] + t * axes[1][i] + axes[2][i]) * invLength;
+
+			float basis[9] =
+			{
+				cSH0,
+				cSH1 * dir[1], cSH1 * dir[2], cSH1 * dir[0],
+				cSH2 * dir[0] * dir[1], cSH2 * dir[1] * dir[2], cSH20 * (3.0f * dir[2] * dir[2] - 1.0f),
+				cSH2 * dir[0] * dir[2], cSH22 * (dir[0] * dir[0] - dir[1] * dir[1])
+			};
+
+			const float* colour = row + x * 4;
+			for (int k = 0; k < 9; k++)
+			{
+				for (int c = 0; c < 3; c++)
+					sums.values[k][c] += basis[k] * weight * colour[c];
+			}
+			sums.weight += weight;
+		}
+	}
+
+#if defined(SIMD_SSE2)
+	// project a row four texels at a time, returns the number of texels projected
+	int projectRowSSE(const float* row, int width, int face, float t, ProjectionSums& sums)
+	{
+		const float (*axes)[3] = cFaceAxes[face];
+		int count = width & ~3;
+		if (count == 0)
+			return 0;
+
+		__m128 sumValues[9][3];
+		for (int k = 0; k < 9; k++)
+		{
+			for (int c = 0; c < 3; c++)
+				sumValues[k][c] = _mm_setzero_ps();
+		}
+		__m128 sumWeight = _mm_setzero_ps();
+
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 tt = _mm_set1_ps(t * t);
+		const __m128 scale = _mm_set1_ps(2.0f / width);
+		const __m128 offset = _mm_set1_ps(1.0f / width - 1.0f);
+
+		for (int x = 0; x < count; x += 4)
+		{
+			// face coordinates of four texel centres
+			__m128 s = _mm_add_ps(_mm_mul_ps(_mm_setr_ps(static_cast<float>(x), static_cast<float>(x + 1),
+				static_cast<float>(x + 2), static_cast<float>(x + 3)), scale), offset);
+
+			// solid angle weight and normalised direction
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(one, _mm_mul_ps(s, s)), tt);
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+			__m128 weight = _mm_div_ps(invLength, lengthSq);
+
+			__m128 dir[3];
+			for (int i = 0; i < 3; i++)
+			{
+				__m128 d = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][i])), _mm_set1_ps(t * axes[1][i] + axes[2][i]));
+				dir[i] = _mm_mul_ps(d, invLength);
+			}
+
+			__m128 basis[9];
+			basis[0] = _mm_set1_ps(cSH0);
+			basis[1] = _mm_mul_ps(_mm_set1_ps(cSH1), dir[1]);
+			basis[2] = _mm_mul_ps(_mm_set1_ps(cSH1), dir[2]);
+			basis[3] = _mm_mul_ps(_mm_set1_ps(cSH1), dir[0]);
+			basis[4] = _mm_mul_ps(_mm_set1_ps(cSH2), _mm_mul_ps(dir[0], dir[1]));
+			basis[5] = _mm_mul_ps(_mm_set1_ps(cSH2), _mm_mul_ps(dir[1], dir[2]));
+			basis[6] = _mm_mul_ps(_mm_set1_ps(cSH20), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(dir[2], dir[2])), one));
+			basis[7] = _mm_mul_ps(_mm_set1_ps(cSH2), _mm_mul_ps(dir[0], dir[2]));
+			basis[8] = _mm_mul_ps(_mm_set1_ps(cSH22), _mm_sub_ps(_mm_mul_ps(dir[0], dir[0]), _mm_mul_ps(dir[1], dir[1])));
+
+			// four RGBA texels to r, g, b and a lanes, pre-weighted by solid angle
+			__m128 r = _mm_loadu_ps(row + x * 4);
+			__m128 g = _mm_loadu_ps(row + x * 4 + 4);
+			__m128 b = _mm_loadu_ps(row + x * 4 + 8);
+			__m128 a = _mm_loadu_ps(row + x * 4 + 12);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			__m128 colour[3] = { _mm_mul_ps(r, weight), _mm_mul_ps(g, weight), _mm_mul_ps(b, weight) };
+
+			for (int k = 0; k < 9; k++)
+			{
+				for (int c = 0; c < 3; c++)
+					sumValues[k][c] = _mm_add_ps(sumValues[k][c], _mm_mul_ps(basis[k], colour[c]));
+			}
+			sumWeight = _mm_add_ps(sumWeight, weight);
+		}
+
+		// reduce the lanes into the face sums
+		float lanes[4];
+		for (int k = 0; k < 9; k++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				_mm_storeu_ps(lanes, sumValues[k][c]);
+				sums.values[k][c] += static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+			}
+		}
+		_mm_storeu_ps(lanes, sumWeight);
+		sums.weight += static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+
+		return count;
+	}
+#endif
+
+	// texel coordinates of samples in a linear float RGBA panorama
+	struct PanoramaSample
+	{
+		int x0, x1, y0, y1;
+		float fx, fy;
+	};
+
+	// bilinear samples [begin, count) one channel at a time
+	void sampleRowGeneric(const float* panorama, int width, const PanoramaSample* samples, int count, int begin,
+		float* out)
+	{
+		for (int i = begin; i < count; i++)
+		{
+			const PanoramaSample& sample = samples[i];
+			const float* p00 = panorama + (static_cast<size_t>(sample.y0) * width + sample.x0) * 4;
+			const float* p10 = panorama + (static_cast<size_t>(sample.y0) * width + sample.x1) * 4;
+			const float* p01 = panorama + (static_cast<size_t>(sample.y1) * width + sample.x0) * 4;
+			const float* p11 = panorama + (static_cast<size_t>(sample.y1) * width + sample.x1) * 4;
+
+			for (int c = 0; c < 4; c++)
+			{
+				float top = p00[c] + (p10[c] - p00[c]) * sample.fx;
+				float bottom = p01[c] + (p11[c] - p01[c]) * sample.fx;
+				out[i * 4 + c] = top + (bottom - top) * sample.fy;
+			}
+		}
+	}
+
+#if defined(SIMD_SSE2)
+	// bilinear samples with all four channels of a texel in one register, returns the number sampled
+	int sampleRowSSE(const float* panorama, int width, const PanoramaSample* samples, int count, float* out)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			const PanoramaSample& sample = samples[i];
+			__m128 p00 = _mm_loadu_ps(panorama + (static_cast<size_t>(sample.y0) * width + sample.x0) * 4);
+			__m128 p10 = _mm_loadu_ps(panorama + (static_cast<size_t>(sample.y0) * width + sample.x1) * 4);
+			__m128 p01 = _mm_loadu_ps(panorama + (static_cast<size_t>(sample.y1) * width + sample.x0) * 4);
+			__m128 p11 = _mm_loadu_ps(panorama + (static_cast<size_t>(sample.y1) * width + sample.x1) * 4);
+
+			__m128 fx = _mm_set1_ps(sample.fx);
+			__m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p10, p00), fx));
+			__m128 bottom = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(p11, p01), fx));
+			_mm_storeu_ps(out + i * 4, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(sample.fy))));
+		}
+
+		return count;
+	}
+#endif
+
+	// average 2x2 blocks of texels
+	void downsample(const CubeImage& source, CubeImage& result)
+	{
+		result.size = std::max(1, source.size / 2);
+		for (int face = 0; face < 6; face++)
+		{
+			result.faces[face].resize(static_cast<size_t>(result.size) * result.size * 4);
+			for (int y = 0; y < result.size; y++)
+			{
+				for (int x = 0; x < result.size; x++)
+				{
+					int sx = std::min(x * 2, source.size - 1);
+					int sy = std::min(y * 2, source.size - 1);
+					int sx1 = std::min(sx + 1, source.size - 1);
+					int sy1 = std::min(sy + 1, source.size - 1);
+
+					float* out = result.texel(face, x, y);
+					for (int c = 0; c < 4; c++)
+					{
+						out[c] = 0.25f * (source.texel(face, sx, sy)[c] + source.texel(face, sx1, sy)[c]
+							+ source.texel(face, sx, sy1)[c] + source.texel(face, sx1, sy1)[c]);
+					}
+				}
+			}
+		}
+	}
+
+	// convolve every texel of an output level with a Phong lobe over the source texels
+	void convolve(const SourceLevel& source, float power, float cosCutoff, CubeImage& result, int numThreads)
+	{
+		int size = result.size;
+
+		// rows of every face are shared out between threads
+		Parallel::forRange(0, 6 * size, [&](int begin, int end)
+		{
+			for (int row = begin; row < end; row++)
+			{
+				int face = row / size;
+				int y = row % size;
+
+				for (int x = 0; x < size; x++)
+				{
+					float n[3];
+					faceDirection(face, faceCoord(x + 0.5f, size), faceCoord(y + 0.5f, size), n);
+
+					float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+					// skip tiles entirely outside the lobe
+					for (const Tile& tile : source.tiles)
+					{
+						if (n[0] * tile.dir[0] + n[1] * tile.dir[1] + n[2] * tile.dir[2] < tile.cosLimit)
+							continue;
+
+						if (tile.children.empty())
+						{
+							accumulate(source, tile, n, power, cosCutoff, sum);
+							continue;
+						}
+
+						for (const Tile& child : tile.children)
+						{
+							if (n[0] * child.dir[0] + n[1] * child.dir[1] + n[2] * child.dir[2] >= child.cosLimit)
+								accumulate(source, child, n, power, cosCutoff, sum);
+						}
+					}
+
+					float* out = result.texel(face, x, y);
+					float scale = sum[3] > 0.0f ? 1.0f / sum[3] : 0.0f;
+					out[0] = sum[0] * scale;
+					out[1] = sum[1] * scale;
+					out[2] = sum[2] * scale;
+					out[3] = 1.0f;
+				}
+			}
+		}, 1, numThreads);
+	}
+}
+
+void EnvironmentMap::fromImages(const unsigned char* const faces[6], int size, int channels, CubeImage& cube)
+{
+	const float* linear = toLinear();
+
+	cube.size = size;
+	for (int face = 0; face < 6; face++)
+	{
+		size_t count = static_cast<size_t>(size) * size;
+		cube.faces[face].resize(count * 4);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned char* in = faces[face] + i * channels;
+			float* out = &cube.faces[face][i * 4];
+			out[0] = linear[in[0]];
+			out[1] = linear[in[channels > 1 ? 1 : 0]];
+			out[2] = linear[in[channels > 2 ? 2 : 0]];
+			out[3] = channels == 4 ? in[3] / 255.0f : 1.0f;
+		}
+	}
+}
+
+void EnvironmentMap::fromPanorama(const unsigned char* pixels, int width, int height, int channels, int size,
+	CubeImage& cube, int numThreads)
+{
+	const float* linear = toLinear();
+	const float pi = 3.14159265f;
+
+	// convert to linear once so samples are filtered in linear light
+	std::vector<float> panorama(static_cast<size_t>(width) * height * 4);
+	Parallel::forRange(0, height, [&](int begin, int end)
+	{
+		for (size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; i++)
+		{
+			const unsigned char* in = pixels + i * channels;
+			float* out = &panorama[i * 4];
+			out[0] = linear[in[0]];
+			out[1] = linear[in[channels > 1 ? 1 : 0]];
+			out[2] = linear[in[channels > 2 ? 2 : 0]];
+			out[3] = channels == 4 ? in[3] / 255.0f : 1.0f;
+		}
+	}, 16, numThreads);
+
+	cube.size = size;
+	for (int face = 0; face < 6; face++)
+		cube.faces[face].resize(static_cast<size_t>(size) * size * 4);
+
+	// rows of every face are shared out between threads
+	Parallel::forRange(0, 6 * size, [&](int begin, int end)
+	{
+		std::vector<PanoramaSample> samples(size);
+
+		for (int row = begin; row < end; row++)
+		{
+			int face = row / size;
+			int y = row % size;
+
+			// longitude wraps around the panorama, latitude is clamped at the poles
+			for (int x = 0; x < size; x++)
+			{
+				float dir[3];
+				faceDirection(face, faceCoord(x + 0.5f, size), faceCoord(y + 0.5f, size), dir);
+
+				float u = (0.5f + std::atan2(dir[0], -dir[2]) / (2.0f * pi)) * width - 0.5f;
+				float v = std::acos(std::min(1.0f, std::max(-1.0f, dir[1]))) / pi * height - 0.5f;
+				float u0 = std::floor(u);
+				float v0 = std::floor(v);
+
+				PanoramaSample& sample = samples[x];
+				sample.fx = u - u0;
+				sample.fy = v - v0;
+				sample.x0 = (static_cast<int>(u0) + width) % width;
+				sample.x1 = (sample.x0 + 1) % width;
+				sample.y0 = std::max(0, static_cast<int>(v0));
+				sample.y1 = std::min(height - 1, static_cast<int>(v0) + 1);
+			}
+
+			float* out = cube.texel(face, 0, y);
+			int x = 0;
+#if defined(SIMD_SSE2)
+			x = sampleRowSSE(panorama.data(), width, samples.data(), size, out);
+#endif
+			sampleRowGeneric(panorama.data(), width, samples.data(), size, x, out);
+		}
+	}, 1, numThreads);
+}
+
+int EnvironmentMap::panoramaFaceSize(int width)
+{
+	return std::max(1, std::min(width / 4, cMaxPanoramaFaceSize));
+}
+
+bool EnvironmentMap::fromTexture(const Texture& texture, CubeImage& cube)
+{
+	std::vector<unsigned char> pixels;
+	int size, height;
+	if (texture.getTarget() != GL_TEXTURE_CUBE_MAP || !texture.read(0, pixels, size, height))
+		return false;
+
+	// faces are returned one after another
+	const unsigned char* faces[6];
+	for (int face = 0; face < 6; face++)
+		faces[face] = pixels.data() + static_cast<size_t>(size) * size * 4 * face;
+
+	fromImages(faces, size, 4, cube);
+	return true;
+}
+
+void EnvironmentMap::toLevels(const CubeImage& cube, std::vector<TextureLevel>& levels)
+{
+	for (int face = 0; face < 6; face++)
+	{
+		TextureLevel level;
+		level.width = cube.size;
+		level.height = cube.size;
+		level.data.resize(cube.faces[face].size());
+
+		for (size_t i = 0; i < cube.faces[face].size(); i += 4)
+		{
+			level.data[i + 0] = toSRGB(cube.faces[face][i + 0]);
+			level.data[i + 1] = toSRGB(cube.faces[face][i + 1]);
+			level.data[i + 2] = toSRGB(cube.faces[face][i + 2]);
+			level.data[i + 3] = static_cast<unsigned char>(std::min(1.0f, std::max(0.0f, cube.faces[face][i + 3])) * 255.0f + 0.5f);
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+int EnvironmentMap::levelCount(int size)
+{
+	int levels = 1;
+	while (size > 1)
+	{
+		size /= 2;
+		levels++;
+	}
+	return levels;
+}
+
+float EnvironmentMap::specularPower(int level, int numLevels)
+{
+	// exponents fall geometrically from cMaxPower at level 1 to 1 at the last level
+	if (level <= 0)
+		return cMaxPower;
+	if (numLevels <= 2)
+		return 1.0f;
+
+	float t = static_cast<float>(level - 1) / (numLevels - 2);
+	return std::pow(cMaxPower, 1.0f - t);
+}
+
+float EnvironmentMap::shininessToLod(float shininess, int numLevels)
+{
+	if (numLevels <= 1)
+		return 0.0f;
+
+	// a Blinn-Phong exponent is about four times the Phong exponent of the same highlight
+	float power = std::max(1.0f, shininess * 0.25f);
+	float lod = 1.0f + (numLevels - 2) * (1.0f - std::log2(power) / std::log2(cMaxPower));
+	return std::min(static_cast<float>(numLevels - 1), std::max(0.0f, lod));
+}
+
+void EnvironmentMap::prefilter(const CubeImage& cube, std::vector<TextureLevel>& levels, int numThreads)
+{
+	int numLevels = levelCount(cube.size);
+	levels.clear();
+
+	// level 0 is the unfiltered source
+	toLevels(cube, levels);
+
+	// each level is filtered from the box filtered level above it, whose texels are
+	// small enough to resolve the lobe, keeping the taps per texel roughly constant
+	// sources are capped at cMaxPrefilterSource so large faces do not multiply the taps
+	CubeImage source = cube;
+	for (int level = 1; level < numLevels; level++)
+	{
+		while (source.size > std::min(cMaxPrefilterSource, std::max(1, cube.size >> (level - 1))))
+		{
+			CubeImage next;
+			downsample(source, next);
+			source = std::move(next);
+		}
+
+		float power = specularPower(level, numLevels);
+		float cosCutoff = std::pow(cLobeCutoff, 1.0f / power);
+
+		SourceLevel texels;
+		texels.build(source, std::acos(cosCutoff));
+
+		CubeImage result;
+		result.size = std::max(1, cube.size >> level);
+		for (int face = 0; face < 6; face++)
+			result.faces[face].resize(static_cast<size_t>(result.size) * result.size * 4);
+
+		convolve(texels, power, cosCutoff, result, numThreads);
+		toLevels(result, levels);
+	}
+}
+
+void EnvironmentMap::projectIrradiance(const CubeImage& cube, IrradianceSH& irradiance, int numThreads)
+{
+	// each face is summed on its own thread
+	ProjectionSums faceSums[6];
+	Parallel::forRange(0, 6, [&](int begin, int end)
+	{
+		for (int face = begin; face < end; face++)
+		{
+			for (int y = 0; y < cube.size; y++)
+			{
+				const float* row = cube.texel(face, 0, y);
+				float t = faceCoord(y + 0.5f, cube.size);
+
+				int x = 0;
+#if defined(SIMD_SSE2)
+				x = projectRowSSE(row, cube.size, face, t, faceSums[face]);
+#endif
+				projectRowGeneric(row, cube.size, face, t, x, faceSums[face]);
+			}
+		}
+	}, 1, numThreads);
+
+	ProjectionSums total;
+	for (const ProjectionSums& sums : faceSums)
+	{
+		for (int k = 0; k < 9; k++)
+		{
+			for (int c = 0; c < 3; c++)
+				total.values[k][c] += sums.values[k][c];
+		}
+		total.weight += sums.weight;
+	}
+
+	// the weights should cover the sphere, normalise them to exactly 4 pi
+	// then convolve with the cosine lobe (pi, 2 pi / 3, pi / 4 per band) and divide by pi
+	const double pi = 3.14159265358979;
+	const double band[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+	double scale = total.weight > 0.0 ? 4.0 * pi / total.weight : 0.0;
+
+	for (int k = 0; k < 9; k++)
+	{
+		for (int c = 0; c < 3; c++)
+			irradiance.coefficients[k][c] = static_cast<float>(total.values[k][c] * scale * band[k]);
+	}
+}
+
+glm::vec3 EnvironmentMap::evaluateIrradiance(const IrradianceSH& irradiance, const glm::vec3& n)
+{
+	const glm::vec3* c = irradiance.coefficients;
+	return c[0] * cSH0
+		+ c[1] * (cSH1 * n.y) + c[2] * (cSH1 * n.z) + c[3] * (cSH1 * n.x)
+		+ c[4] * (cSH2 * n.x * n.y) + c[5] * (cSH2 * n.y * n.z) + c[6] * (cSH20 * (3.0f * n.z * n.z - 1.0f))
+		+ c[7] * (cSH2 * n.x * n.z) + c[8] * (cSH22 * (n.x * n.x - n.y * n.y));
+}
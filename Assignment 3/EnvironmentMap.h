@@ -0,0 +1,77 @@
+#ifndef ENVIRONMENT_MAP_H
+#define ENVIRONMENT_MAP_H
+
+#include <vector>
+
+#include "TextureCache.h"
+#include "utilities.h"
+
+class Texture;
+
+// linear float RGBA cube map, faces in OpenGL order: +X, -X, +Y, -Y, +Z, -Z
+// rows are in upload order, so row 0 is t = -1 on each face
+struct CubeImage
+{
+	int size = 0;
+	std::vector<float> faces[6];
+
+	float* texel(int face, int x, int y) { return &faces[face][(static_cast<size_t>(y) * size + x) * 4]; }
+	const float* texel(int face, int x, int y) const { return &faces[face][(static_cast<size_t>(y) * size + x) * 4]; }
+};
+
+// irradiance as nine RGB spherical harmonic coefficients (bands 0 to 2)
+// coefficients are convolved with the cosine lobe and divided by pi, so evaluating the
+// basis at a normal gives the ambient radiance a Lambertian surface reflects
+struct IrradianceSH
+{
+	glm::vec3 coefficients[9];
+};
+
+/*****************************************************************
+ * CPU processing of environment cube maps
+ * prefiltered specular mip chains for glossy reflections and
+ * spherical harmonic irradiance for diffuse ambient, work is
+ * split across threads by face and row
+ *****************************************************************/
+namespace EnvironmentMap
+{
+	// Phong exponent of the sharpest prefiltered lobe (level 1, level 0 is the source)
+	const float cMaxPower = 2048.0f;
+	// largest face size resampled from a panorama
+	const int cMaxPanoramaFaceSize = 512;
+	// largest source face size the lobes are convolved from, finer levels are filtered from a box filtered copy
+	// the sharpest lobe spans several texels of this size, and the cost grows with the square of the source texels
+	const int cMaxPrefilterSource = 128;
+
+	// convert six sRGB face images (3 or 4 channels, OpenGL face order) to a linear float cube
+	void fromImages(const unsigned char* const faces[6], int size, int channels, CubeImage& cube);
+	// resample an sRGB equirectangular panorama (3 or 4 channels, top row first) to a linear float cube
+	// the centre of the panorama faces -Z, faces are resampled in parallel by face and row
+	void fromPanorama(const unsigned char* pixels, int width, int height, int channels, int size, CubeImage& cube,
+		int numThreads = 0);
+	// face size for a panorama, a quarter of its width up to cMaxPanoramaFaceSize
+	int panoramaFaceSize(int width);
+	// read back level 0 of a cube map texture, call on the GL thread
+	// returns false if the texture is not a loaded cube map
+	bool fromTexture(const Texture& texture, CubeImage& cube);
+	// encode a linear float cube as six sRGB RGBA8 levels
+	void toLevels(const CubeImage& cube, std::vector<TextureLevel>& levels);
+
+	// number of levels in the prefiltered chain of a face size
+	int levelCount(int size);
+	// Phong exponent that a level is convolved with, level 0 is the unfiltered source
+	float specularPower(int level, int numLevels);
+	// level to sample for a Blinn-Phong material shininess
+	float shininessToLod(float shininess, int numLevels);
+
+	// convolve a cube with a Phong lobe per mip level
+	// levels are sRGB RGBA8, ordered level by level with six faces per level
+	void prefilter(const CubeImage& cube, std::vector<TextureLevel>& levels, int numThreads = 0);
+
+	// project a cube onto spherical harmonics, faces are projected in parallel
+	void projectIrradiance(const CubeImage& cube, IrradianceSH& irradiance, int numThreads = 0);
+	// evaluate irradiance for a unit normal, matching the shaders
+	glm::vec3 evaluateIrradiance(const IrradianceSH& irradiance, const glm::vec3& normal);
+}
+
+#endif
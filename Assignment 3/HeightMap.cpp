@@ -0,0 +1,122 @@
+#include "HeightMap.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// encode a unit component as the nearest byte of the c / 127.5 - 1 decode, ties to even like the SSE kernel
+	inline uint32_t encode(float n)
+	{
+		return static_cast<uint32_t>(std::nearbyint(n * 127.5f + 127.5f));
+	}
+
+	// generic kernel, wraps at the row ends
+	// below and above are the rows before and after in memory
+	void sobelRowGeneric(const unsigned char* below, const unsigned char* row, const unsigned char* above,
+		int width, float scale, uint32_t* out, int xBegin, int xEnd)
+	{
+		for (int x = xBegin; x < xEnd; x++)
+		{
+			int left = (x == 0) ? width - 1 : x - 1;
+			int right = (x == width - 1) ? 0 : x + 1;
+
+			int gx = (below[right] + 2 * row[right] + above[right]) - (below[left] + 2 * row[left] + above[left]);
+			int gy = (above[left] + 2 * above[x] + above[right]) - (below[left] + 2 * below[x] + below[right]);
+
+			float nx = -gx * scale;
+			float ny = -gy * scale;
+			float inverseLength = 1.0f / std::sqrt(nx * nx + ny * ny + 1.0f);
+
+			out[x] = encode(nx * inverseLength) | (encode(ny * inverseLength) << 8) | (encode(inverseLength) << 16)
+				| 0xFF000000u;
+		}
+	}
+
+#if defined(SIMD_SSE2)
+	// load four heights as floats
+	inline __m128 loadHeights(const unsigned char* p)
+	{
+		int32_t bytes;
+		std::memcpy(&bytes, p, sizeof(bytes));
+		__m128i zero = _mm_setzero_si128();
+		__m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+	}
+
+	// four pixels per iteration from x = 1, neighbours must be inside the row
+	// returns the first pixel not written
+	int sobelRowSSE(const unsigned char* below, const unsigned char* row, const unsigned char* above,
+		int width, float scale, uint32_t* out)
+	{
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 negativeScale = _mm_set1_ps(-scale);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(127.5f);
+		const __m128 bias = _mm_set1_ps(127.5f);
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+		int x = 1;
+		for (; x + 4 < width; x += 4)
+		{
+			__m128 belowLeft = loadHeights(below + x - 1);
+			__m128 belowCentre = loadHeights(below + x);
+			__m128 belowRight = loadHeights(below + x + 1);
+			__m128 aboveLeft = loadHeights(above + x - 1);
+			__m128 aboveCentre = loadHeights(above + x);
+			__m128 aboveRight = loadHeights(above + x + 1);
+
+			__m128 right = _mm_add_ps(_mm_add_ps(belowRight, aboveRight), _mm_mul_ps(two, loadHeights(row + x + 1)));
+			__m128 left = _mm_add_ps(_mm_add_ps(belowLeft, aboveLeft), _mm_mul_ps(two, loadHeights(row + x - 1)));
+			__m128 up = _mm_add_ps(_mm_add_ps(aboveLeft, aboveRight), _mm_mul_ps(two, aboveCentre));
+			__m128 down = _mm_add_ps(_mm_add_ps(belowLeft, belowRight), _mm_mul_ps(two, belowCentre));
+
+			__m128 nx = _mm_mul_ps(_mm_sub_ps(right, left), negativeScale);
+			__m128 ny = _mm_mul_ps(_mm_sub_ps(up, down), negativeScale);
+			__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), one);
+			__m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+			// encode rounding to nearest and interleave as RGBA bytes
+			__m128i r = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(nx, inverseLength), half), bias));
+			__m128i g = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(ny, inverseLength), half), bias));
+			__m128i b = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(inverseLength, half), bias));
+			__m128i pixels = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixels);
+		}
+
+		return x;
+	}
+#endif
+}
+
+void HeightMap::toNormalMap(const unsigned char* heights, int width, int height, float strength,
+	std::vector<unsigned char>& rgba, int numThreads)
+{
+	rgba.resize(static_cast<size_t>(width) * height * 4);
+	uint32_t* pixels = reinterpret_cast<uint32_t*>(rgba.data());
+
+	// the Sobel sums weigh each side by 4 and span two texels, heights are bytes
+	float scale = strength / (8.0f * 255.0f);
+
+	Parallel::forRange(0, height, [&](int yBegin, int yEnd)
+	{
+		for (int y = yBegin; y < yEnd; y++)
+		{
+			// rows wrap like the texture
+			const unsigned char* below = heights + static_cast<size_t>(y == 0 ? height - 1 : y - 1) * width;
+			const unsigned char* row = heights + static_cast<size_t>(y) * width;
+			const unsigned char* above = heights + static_cast<size_t>(y == height - 1 ? 0 : y + 1) * width;
+			uint32_t* out = pixels + static_cast<size_t>(y) * width;
+
+			int x = 0;
+#if defined(SIMD_SSE2)
+			sobelRowGeneric(below, row, above, width, scale, out, 0, 1);
+			x = sobelRowSSE(below, row, above, width, scale, out);
+#endif
+			sobelRowGeneric(below, row, above, width, scale, out, x, width);
+		}
+	}, 16, numThreads);
+}
@@ -0,0 +1,24 @@
+#ifndef HEIGHT_MAP_H
+#define HEIGHT_MAP_H
+
+#include <vector>
+
+/*****************************************************************
+ * tangent space normal maps derived from 8-bit height maps
+ * slopes are taken with a 3x3 Sobel filter that wraps at the
+ * edges so tiling textures stay seamless, rows are split across
+ * threads and filtered four pixels at a time with SSE2
+ *****************************************************************/
+namespace HeightMap
+{
+	// default slope scale, heights are 0 to 1 and a rise of 1/8 across one texel gives a 45 degree slope
+	const float cDefaultStrength = 8.0f;
+
+	// build an RGBA8 normal map (X, Y, Z encoded as n * 0.5 + 0.5, alpha 255) from one byte per texel
+	// rows are bottom-up as uploaded, so +Y follows increasing rows
+	// strength scales the slopes, larger values give deeper relief
+	void toNormalMap(const unsigned char* heights, int width, int height, float strength,
+		std::vector<unsigned char>& rgba, int numThreads = 0);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/*****************************************************************
+ * read-only memory-mapped file
+ *****************************************************************/
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// map a whole file into memory, returns false if it cannot be mapped
+	bool open(const std::string& filename);
+	// unmap the file
+	void close();
+
+	const unsigned char* data() const;
+	size_t size() const;
+
+private:
+	const unsigned char* mData = nullptr;
+	size_t mSize = 0;
+
+	// platform handles
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "TextureCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// cache file header, followed by the submesh and level error tables and the vertex and index arrays at aligned offsets
+	struct MeshHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t vertexStride;
+		uint32_t numVertices;
+		uint32_t numIndices;
+		uint32_t hasTexCoords;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t numSubmeshes;
+		uint32_t numLods;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+	};
+
+	const char cMagic[4] = { 'M', 'S', 'H', 'C' };
+	const uint32_t cVersion = 4;
+
+	// submesh table entry
+	struct SubmeshEntry
+	{
+		int32_t baseVertex;
+		int32_t firstIndex;
+		int32_t numIndices;
+		int32_t materialIndex;
+	};
+
+	// vertex and index arrays start on a 16 byte boundary within the file
+	const uint64_t cAlignment = 16;
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + cAlignment - 1) & ~(cAlignment - 1);
+	}
+}
+
+bool MeshCache::makeKey(const std::string& filename, bool texCoords, uint64_t& key)
+{
+	// the source is hashed through a mapping so large models are not copied
+	MappedFile file;
+	if (!file.open(filename))
+		return false;
+
+	uint32_t tag[2] = { texCoords ? 1u : 0u, cVersion };
+	key = TextureCache::hash(tag, sizeof(tag), TextureCache::hash(file.data(), file.size()));
+	return true;
+}
+
+bool MeshCache::load(uint64_t key, MeshData& data)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(TextureCache::path(key, "mesh")) || file->size() < sizeof(MeshHeader))
+		return false;
+
+	// validate header and that the tables and both arrays lie within the file
+	MeshHeader header;
+	std::memcpy(&header, file->data(), sizeof(header));
+
+	if (std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 || header.version != cVersion || header.key != key)
+		return false;
+
+	uint64_t vertexBytes = static_cast<uint64_t>(header.vertexStride) * header.numVertices;
+	uint64_t indexBytes = static_cast<uint64_t>(header.numIndices) * sizeof(GLuint);
+	uint64_t tableBytes = static_cast<uint64_t>(header.numSubmeshes) * sizeof(SubmeshEntry) + header.numLods * sizeof(float);
+	if (header.numLods == 0 || header.numSubmeshes % header.numLods != 0
+		|| header.vertexOffset % cAlignment != 0 || header.indexOffset % cAlignment != 0
+		|| sizeof(MeshHeader) + tableBytes > header.vertexOffset
+		|| header.vertexOffset + vertexBytes > file->size() || header.indexOffset + indexBytes > file->size())
+	{
+		std::cerr << "Corrupt mesh cache file: " << TextureCache::path(key, "mesh") << std::endl;
+		return false;
+	}
+
+	data.vertexStride = static_cast<int>(header.vertexStride);
+	data.numVertices = static_cast<int>(header.numVertices);
+	data.numIndices = static_cast<int>(header.numIndices);
+	data.hasTexCoords = header.hasTexCoords != 0;
+	std::memcpy(data.boundsMin, header.boundsMin, sizeof(data.boundsMin));
+	std::memcpy(data.boundsMax, header.boundsMax, sizeof(data.boundsMax));
+
+	// the tables are small and copied out of the mapping
+	data.submeshes.resize(header.numSubmeshes);
+	for (uint32_t i = 0; i < header.numSubmeshes; i++)
+	{
+		SubmeshEntry entry;
+		std::memcpy(&entry, file->data() + sizeof(MeshHeader) + i * sizeof(SubmeshEntry), sizeof(entry));
+		data.submeshes[i].baseVertex = entry.baseVertex;
+		data.submeshes[i].firstIndex = entry.firstIndex;
+		data.submeshes[i].numIndices = entry.numIndices;
+		data.submeshes[i].materialIndex = entry.materialIndex;
+
+		if (entry.baseVertex < 0 || entry.baseVertex >= data.numVertices || entry.firstIndex < 0 || entry.numIndices < 0
+			|| static_cast<int64_t>(entry.firstIndex) + entry.numIndices > data.numIndices)
+		{
+			std::cerr << "Corrupt mesh cache file: " << TextureCache::path(key, "mesh") << std::endl;
+			return false;
+		}
+	}
+
+	data.lodErrors.assign(header.numLods, 0.0f);
+	std::memcpy(data.lodErrors.data(), file->data() + sizeof(MeshHeader) + header.numSubmeshes * sizeof(SubmeshEntry),
+		header.numLods * sizeof(float));
+	if (header.numLods == 1)
+		data.lodErrors.clear();
+
+	// vertices and indices stay in the mapping
+	data.vertices = file->data() + header.vertexOffset;
+	data.indices = reinterpret_cast<const GLuint*>(file->data() + header.indexOffset);
+	data.vertexStorage.clear();
+	data.indexStorage.clear();
+	data.mapping = file;
+
+	return true;
+}
+
+bool MeshCache::store(uint64_t key, const MeshData& data)
+{
+	std::string path = TextureCache::path(key, "mesh");
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+	// write to a temporary file first so a partial write is never mapped
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cerr << "Unable to write mesh cache: " << path << std::endl;
+		return false;
+	}
+
+	uint64_t vertexBytes = static_cast<uint64_t>(data.vertexStride) * data.numVertices;
+	uint64_t indexBytes = static_cast<uint64_t>(data.numIndices) * sizeof(GLuint);
+	std::vector<float> lodErrors = data.lodErrors;
+	if (lodErrors.empty())
+		lodErrors.push_back(0.0f);
+	uint64_t tableBytes = data.submeshes.size() * sizeof(SubmeshEntry) + lodErrors.size() * sizeof(float);
+
+	std::vector<SubmeshEntry> table;
+	for (const Submesh& submesh : data.submeshes)
+		table.push_back({ submesh.baseVertex, submesh.firstIndex, submesh.numIndices, submesh.materialIndex });
+
+	MeshHeader header = {};
+	std::memcpy(header.magic, cMagic, sizeof(cMagic));
+	header.version = cVersion;
+	header.key = key;
+	header.vertexStride = static_cast<uint32_t>(data.vertexStride);
+	header.numVertices = static_cast<uint32_t>(data.numVertices);
+	header.numIndices = static_cast<uint32_t>(data.numIndices);
+	header.hasTexCoords = data.hasTexCoords ? 1 : 0;
+	std::memcpy(header.boundsMin, data.boundsMin, sizeof(header.boundsMin));
+	std::memcpy(header.boundsMax, data.boundsMax, sizeof(header.boundsMax));
+	header.numSubmeshes = static_cast<uint32_t>(data.submeshes.size());
+	header.numLods = static_cast<uint32_t>(lodErrors.size());
+	header.vertexOffset = align(sizeof(MeshHeader) + tableBytes);
+	header.indexOffset = align(header.vertexOffset + vertexBytes);
+
+	// header and tables, then each array padded to its offset
+	const char padding[cAlignment] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(SubmeshEntry)));
+	file.write(reinterpret_cast<const char*>(lodErrors.data()), static_cast<std::streamsize>(lodErrors.size() * sizeof(float)));
+	file.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(header) - tableBytes));
+	file.write(reinterpret_cast<const char*>(data.vertices), static_cast<std::streamsize>(vertexBytes));
+	file.write(padding, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - vertexBytes));
+	file.write(reinterpret_cast<const char*>(data.indices), static_cast<std::streamsize>(indexBytes));
+	file.close();
+
+	if (!file)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
@@ -0,0 +1,74 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <GLEW/glew.h>
+
+class MappedFile;
+
+// range of the shared vertex and index arrays holding one mesh of a model
+// indices are relative to baseVertex
+struct Submesh
+{
+	int baseVertex = 0;
+	int firstIndex = 0;
+	int numIndices = 0;
+	int materialIndex = 0;		// aiMesh material of the source mesh
+};
+
+// interleaved vertices and indices of the meshes of a model, ready to be uploaded
+// loaded meshes point into a memory-mapped cache file, imported meshes into their own storage
+struct MeshData
+{
+	int vertexStride = 0;		// bytes per vertex, sizeof(VertexNormal) or sizeof(VertexNormTex)
+	int numVertices = 0;
+	int numIndices = 0;
+	bool hasTexCoords = false;	// whether the source had texture coordinates
+	float boundsMin[3] = {};
+	float boundsMax[3] = {};
+	std::vector<Submesh> submeshes;		// grouped by level of detail, full detail first
+	std::vector<float> lodErrors;		// simplification error of each level in model units, empty for one level
+
+	const unsigned char* vertices = nullptr;
+	const GLuint* indices = nullptr;
+
+	std::vector<unsigned char> vertexStorage;
+	std::vector<GLuint> indexStorage;
+	std::shared_ptr<MappedFile> mapping;	// keeps mapped vertices and indices alive
+
+	// number of levels of detail, submeshes holds this many equal groups
+	int lodCount() const
+	{
+		return lodErrors.empty() ? 1 : static_cast<int>(lodErrors.size());
+	}
+
+	// point vertices and indices at the owned storage
+	void useStorage()
+	{
+		vertices = vertexStorage.data();
+		indices = indexStorage.data();
+	}
+};
+
+/*****************************************************************
+ * on-disk cache of imported meshes, keyed by a content hash of
+ * the source model and the vertex layout it was imported with.
+ * cache files are memory-mapped so vertices and indices go
+ * straight from the page cache to glBufferData
+ *****************************************************************/
+namespace MeshCache
+{
+	// cache key of a model file imported with or without texture coordinates
+	// returns false if the file cannot be read
+	bool makeKey(const std::string& filename, bool texCoords, uint64_t& key);
+
+	// map the cached mesh for a key, returns false on a cache miss
+	bool load(uint64_t key, MeshData& data);
+	// write an imported mesh for a key
+	bool store(uint64_t key, const MeshData& data);
+}
+
+#endif
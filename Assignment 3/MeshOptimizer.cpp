@@ -0,0 +1,365 @@
+#include "MeshOptimizer.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const GLuint cUnused = ~0u;
+
+	// FIFO cache simulated with time stamps, a vertex is cached while fewer than cacheSize misses followed its own
+	struct CacheSimulation
+	{
+		std::vector<unsigned int> times;
+		unsigned int time;
+		int size;
+
+		CacheSimulation(int numVertices, int cacheSize)
+			: times(numVertices, 0), time(cacheSize + 1), size(cacheSize)
+		{}
+
+		// returns 1 if the vertex had to be transformed
+		int access(GLuint vertex)
+		{
+			if (time - times[vertex] > static_cast<unsigned int>(size))
+			{
+				times[vertex] = time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		// empty the cache
+		void flush()
+		{
+			time += size + 1;
+		}
+	};
+
+	// read the position at the start of a vertex
+	inline void readPosition(const unsigned char* vertices, int vertexStride, GLuint vertex, float position[3])
+	{
+		std::memcpy(position, vertices + static_cast<size_t>(vertex) * vertexStride, sizeof(float) * 3);
+	}
+
+	// next vertex to fan around once the candidates are exhausted, -1 when every triangle is emitted
+	int skipDeadEnd(const std::vector<int>& liveCount, std::vector<GLuint>& deadEnd, int& cursor)
+	{
+		// most recently used vertices first, they are likely to still be cached
+		while (!deadEnd.empty())
+		{
+			GLuint vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveCount[vertex] > 0)
+				return static_cast<int>(vertex);
+		}
+
+		for (; cursor < static_cast<int>(liveCount.size()); cursor++)
+		{
+			if (liveCount[cursor] > 0)
+				return cursor;
+		}
+
+		return -1;
+	}
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const GLuint* indices, int numIndices, int numVertices, int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.numTriangles = numIndices / 3;
+
+	CacheSimulation cache(numVertices, cacheSize);
+	std::vector<bool> referenced(numVertices, false);
+
+	for (int i = 0; i < numIndices; i++)
+	{
+		stats.numMisses += cache.access(indices[i]);
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			stats.numVertices++;
+		}
+	}
+
+	return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(const GLuint* indices, int numIndices, int numVertices, std::vector<GLuint>& result,
+	std::vector<int>& clusterStarts, int cacheSize)
+{
+	result.clear();
+	clusterStarts.clear();
+
+	int numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	result.reserve(numIndices);
+
+	// triangles around each vertex
+	std::vector<int> liveCount(numVertices, 0);
+	for (int i = 0; i < numTriangles * 3; i++)
+		liveCount[indices[i]]++;
+
+	std::vector<int> offsets(numVertices + 1, 0);
+	for (int v = 0; v < numVertices; v++)
+		offsets[v + 1] = offsets[v] + liveCount[v];
+
+	std::vector<int> adjacency(numTriangles * 3);
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for (int i = 0; i < numTriangles * 3; i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	CacheSimulation cache(numVertices, cacheSize);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<GLuint> deadEnd;
+	std::vector<GLuint> candidates;
+	int cursor = 0;
+
+	int fan = static_cast<int>(indices[0]);
+	clusterStarts.push_back(0);
+
+	while (fan >= 0)
+	{
+		// emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (int a = offsets[fan]; a < offsets[fan + 1]; a++)
+		{
+			int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint vertex = indices[triangle * 3 + k];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				liveCount[vertex]--;
+				cache.access(vertex);
+			}
+			emitted[triangle] = true;
+		}
+
+		// prefer the oldest candidate that stays cached while its remaining triangles are emitted
+		int next = -1;
+		int bestPriority = -1;
+		for (GLuint vertex : candidates)
+		{
+			if (liveCount[vertex] <= 0)
+				continue;
+
+			int priority = 0;
+			int age = static_cast<int>(cache.time - cache.times[vertex]);
+			if (age + 2 * liveCount[vertex] <= cacheSize)
+				priority = age;
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = static_cast<int>(vertex);
+			}
+		}
+
+		if (next < 0)
+		{
+			next = skipDeadEnd(liveCount, deadEnd, cursor);
+			if (next >= 0)
+				clusterStarts.push_back(static_cast<int>(result.size()));
+		}
+
+		fan = next;
+	}
+}
+
+void MeshOptimizer::optimizeOverdraw(GLuint* indices, int numIndices, const unsigned char* vertices, int vertexStride,
+	int numVertices, const std::vector<int>& clusterStarts, float threshold, int cacheSize)
+{
+	numIndices -= numIndices % 3;
+	if (numIndices == 0 || clusterStarts.empty())
+		return;
+
+	// split the clusters further wherever the cache order would not suffer much from a flush
+	float meshAcmr = analyzeVertexCache(indices, numIndices, numVertices, cacheSize).acmr();
+
+	std::vector<int> starts;
+	CacheSimulation cache(numVertices, cacheSize);
+	for (size_t c = 0; c < clusterStarts.size(); c++)
+	{
+		int end = (c + 1 < clusterStarts.size()) ? clusterStarts[c + 1] : numIndices;
+		int begin = clusterStarts[c];
+		int misses = 0;
+
+		cache.flush();
+		starts.push_back(begin);
+
+		for (int i = begin; i < end; i += 3)
+		{
+			misses += cache.access(indices[i]) + cache.access(indices[i + 1]) + cache.access(indices[i + 2]);
+
+			int triangles = (i + 3 - begin) / 3;
+			if (i + 3 < end && misses <= threshold * meshAcmr * triangles)
+			{
+				begin = i + 3;
+				misses = 0;
+				cache.flush();
+				starts.push_back(begin);
+			}
+		}
+	}
+
+	// mesh centroid over all triangle corners
+	double meshCentroid[3] = {};
+	for (int i = 0; i < numIndices; i++)
+	{
+		float position[3];
+		readPosition(vertices, vertexStride, indices[i], position);
+		for (int k = 0; k < 3; k++)
+			meshCentroid[k] += position[k];
+	}
+	for (int k = 0; k < 3; k++)
+		meshCentroid[k] /= numIndices;
+
+	// clusters facing away from the centre are likely to occlude the rest
+	std::vector<float> keys(starts.size(), 0.0f);
+	for (size_t c = 0; c < starts.size(); c++)
+	{
+		int end = (c + 1 < starts.size()) ? starts[c + 1] : numIndices;
+		double centroid[3] = {};
+		double normal[3] = {};
+		double area = 0.0;
+
+		for (int i = starts[c]; i < end; i += 3)
+		{
+			float p0[3], p1[3], p2[3];
+			readPosition(vertices, vertexStride, indices[i], p0);
+			readPosition(vertices, vertexStride, indices[i + 1], p1);
+			readPosition(vertices, vertexStride, indices[i + 2], p2);
+
+			double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			double triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int k = 0; k < 3; k++)
+			{
+				centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0 * triangleArea;
+				normal[k] += n[k];
+			}
+			area += triangleArea;
+		}
+
+		double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area <= 0.0 || normalLength <= 0.0)
+			continue;
+
+		double key = 0.0;
+		for (int k = 0; k < 3; k++)
+			key += (centroid[k] / area - meshCentroid[k]) * normal[k] / normalLength;
+		keys[c] = static_cast<float>(key);
+	}
+
+	// stable sort keeps equal keys in cache order
+	std::vector<int> order(starts.size());
+	for (size_t c = 0; c < order.size(); c++)
+		order[c] = static_cast<int>(c);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] > keys[b]; });
+
+	std::vector<GLuint> sorted;
+	sorted.reserve(numIndices);
+	for (int c : order)
+	{
+		int end = (c + 1 < static_cast<int>(starts.size())) ? starts[c + 1] : numIndices;
+		sorted.insert(sorted.end(), indices + starts[c], indices + end);
+	}
+	std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+void MeshOptimizer::optimizeVertexFetch(unsigned char* vertices, int vertexStride, int numVertices, GLuint* indices, int numIndices)
+{
+	std::vector<GLuint> remap(numVertices, cUnused);
+	GLuint next = 0;
+
+	for (int i = 0; i < numIndices; i++)
+	{
+		if (remap[indices[i]] == cUnused)
+			remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+	for (int v = 0; v < numVertices; v++)
+	{
+		if (remap[v] == cUnused)
+			remap[v] = next++;
+	}
+
+	std::vector<unsigned char> sorted(static_cast<size_t>(vertexStride) * numVertices);
+	for (int v = 0; v < numVertices; v++)
+	{
+		std::memcpy(sorted.data() + static_cast<size_t>(remap[v]) * vertexStride,
+			vertices + static_cast<size_t>(v) * vertexStride, vertexStride);
+	}
+	std::copy(sorted.begin(), sorted.end(), vertices);
+}
+
+void MeshOptimizer::optimize(MeshData& data, VertexCacheStats& before, VertexCacheStats& after, int numThreads)
+{
+	before = VertexCacheStats();
+	after = VertexCacheStats();
+
+	// mapped cache files are read only
+	if (data.vertices != data.vertexStorage.data() || data.indices != data.indexStorage.data())
+		return;
+
+	// each submesh owns the vertices up to the next base vertex
+	std::vector<int> bases;
+	for (const Submesh& submesh : data.submeshes)
+		bases.push_back(submesh.baseVertex);
+	bases.push_back(data.numVertices);
+	std::sort(bases.begin(), bases.end());
+
+	int numSubmeshes = static_cast<int>(data.submeshes.size());
+	std::vector<VertexCacheStats> submeshBefore(numSubmeshes);
+	std::vector<VertexCacheStats> submeshAfter(numSubmeshes);
+
+	Parallel::forRange(0, numSubmeshes, [&](int begin, int end)
+	{
+		std::vector<GLuint> reordered;
+		std::vector<int> clusterStarts;
+
+		for (int s = begin; s < end; s++)
+		{
+			const Submesh& submesh = data.submeshes[s];
+			int numVertices = *std::upper_bound(bases.begin(), bases.end(), submesh.baseVertex) - submesh.baseVertex;
+			unsigned char* vertices = data.vertexStorage.data() + static_cast<size_t>(submesh.baseVertex) * data.vertexStride;
+			GLuint* indices = data.indexStorage.data() + submesh.firstIndex;
+			int numIndices = submesh.numIndices - submesh.numIndices % 3;
+
+			// leave submeshes with out of range indices as imported
+			if (std::any_of(indices, indices + numIndices, [&](GLuint index) { return index >= static_cast<GLuint>(numVertices); }))
+				continue;
+
+			submeshBefore[s] = analyzeVertexCache(indices, numIndices, numVertices);
+
+			optimizeVertexCache(indices, numIndices, numVertices, reordered, clusterStarts);
+			std::copy(reordered.begin(), reordered.end(), indices);
+			optimizeOverdraw(indices, numIndices, vertices, data.vertexStride, numVertices, clusterStarts);
+			optimizeVertexFetch(vertices, data.vertexStride, numVertices, indices, numIndices);
+
+			submeshAfter[s] = analyzeVertexCache(indices, numIndices, numVertices);
+		}
+	}, 1, numThreads);
+
+	// sum in submesh order so the totals do not depend on the thread count
+	for (int s = 0; s < numSubmeshes; s++)
+	{
+		before.numTriangles += submeshBefore[s].numTriangles;
+		before.numVertices += submeshBefore[s].numVertices;
+		before.numMisses += submeshBefore[s].numMisses;
+		after.numTriangles += submeshAfter[s].numTriangles;
+		after.numVertices += submeshAfter[s].numVertices;
+		after.numMisses += submeshAfter[s].numMisses;
+	}
+}
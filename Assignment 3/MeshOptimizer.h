@@ -0,0 +1,55 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+
+#include "MeshCache.h"
+
+// post-transform cache efficiency of an index order, simulated with a FIFO cache
+struct VertexCacheStats
+{
+	int numTriangles = 0;
+	int numVertices = 0;		// distinct vertices referenced
+	int numMisses = 0;			// vertices transformed
+
+	// average cache miss ratio, transformed vertices per triangle (0.5 is ideal on a regular grid, 3 is worst)
+	float acmr() const { return numTriangles > 0 ? static_cast<float>(numMisses) / numTriangles : 0.0f; }
+	// average transform to vertex ratio, transformed vertices per referenced vertex (1 is ideal)
+	float atvr() const { return numVertices > 0 ? static_cast<float>(numMisses) / numVertices : 0.0f; }
+};
+
+/*****************************************************************
+ * import-time index and vertex reordering for triangle meshes
+ * triangles are ordered for the post-transform vertex cache with
+ * Tipsify, the resulting clusters are sorted front to back for
+ * overdraw, and vertices are renumbered in order of first use
+ * for fetch locality. every step is deterministic
+ *****************************************************************/
+namespace MeshOptimizer
+{
+	// cache size the orders are tuned for and analysed with
+	const int cCacheSize = 16;
+	// clusters may be split while their ACMR stays within this factor of the whole mesh
+	const float cOverdrawThreshold = 1.05f;
+
+	// simulate a FIFO post-transform cache over a triangle list
+	VertexCacheStats analyzeVertexCache(const GLuint* indices, int numIndices, int numVertices, int cacheSize = cCacheSize);
+
+	// reorder triangles for the post-transform cache (Tipsify)
+	// clusterStarts receives the first index of each run started after a dead end
+	void optimizeVertexCache(const GLuint* indices, int numIndices, int numVertices, std::vector<GLuint>& result,
+		std::vector<int>& clusterStarts, int cacheSize = cCacheSize);
+	// reorder the clusters of a cache optimized triangle list so outward facing ones are drawn first
+	// positions are three floats at the start of each vertex
+	void optimizeOverdraw(GLuint* indices, int numIndices, const unsigned char* vertices, int vertexStride,
+		int numVertices, const std::vector<int>& clusterStarts, float threshold = cOverdrawThreshold,
+		int cacheSize = cCacheSize);
+	// renumber vertices in order of first use, unreferenced vertices move to the end
+	void optimizeVertexFetch(unsigned char* vertices, int vertexStride, int numVertices, GLuint* indices, int numIndices);
+
+	// run all three steps on each submesh of mesh data that owns its storage, submeshes are split across threads
+	// before and after are summed over the submeshes
+	void optimize(MeshData& data, VertexCacheStats& before, VertexCacheStats& after, int numThreads = 0);
+}
+
+#endif
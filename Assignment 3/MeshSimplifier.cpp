@@ -0,0 +1,372 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// symmetric 4x4 error quadric, upper triangle in row order
+	struct Quadric
+	{
+		double a[10] = {};
+
+		void addPlane(const double n[3], double d)
+		{
+			const double p[4] = { n[0], n[1], n[2], d };
+			int k = 0;
+			for (int i = 0; i < 4; i++)
+				for (int j = i; j < 4; j++)
+					a[k++] += p[i] * p[j];
+		}
+
+		void add(const Quadric& other)
+		{
+			for (int k = 0; k < 10; k++)
+				a[k] += other.a[k];
+		}
+
+		// summed squared distance of a point to the planes
+		double evaluate(const float p[3]) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double error = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+				+ a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+				+ a[7] * z * z + 2.0 * a[8] * z
+				+ a[9];
+			return std::max(error, 0.0);
+		}
+	};
+
+	// candidate collapse of vertex from onto vertex to
+	struct Collapse
+	{
+		double cost;
+		GLuint from;
+		GLuint to;
+	};
+
+	// unnormalised normal of a triangle
+	void triangleNormal(const float* p0, const float* p1, const float* p2, double n[3])
+	{
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	inline uint64_t edgeKey(GLuint a, GLuint b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+}
+
+float MeshSimplifier::simplify(const GLuint* indices, int numIndices, const unsigned char* vertices, int vertexStride,
+	int numVertices, int targetIndices, std::vector<GLuint>& result)
+{
+	result.assign(indices, indices + (numIndices - numIndices % 3));
+
+	std::vector<float> positions(static_cast<size_t>(numVertices) * 3);
+	for (int v = 0; v < numVertices; v++)
+		std::memcpy(&positions[v * 3], vertices + static_cast<size_t>(v) * vertexStride, sizeof(float) * 3);
+
+	// each vertex starts with the planes of its triangles
+	std::vector<Quadric> quadrics(numVertices);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		double n[3];
+		triangleNormal(&positions[result[i] * 3], &positions[result[i + 1] * 3], &positions[result[i + 2] * 3], n);
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length <= 0.0)
+			continue;
+
+		for (int k = 0; k < 3; k++)
+			n[k] /= length;
+		const float* p = &positions[result[i] * 3];
+		double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+
+		for (int k = 0; k < 3; k++)
+			quadrics[result[i + k]].addPlane(n, d);
+	}
+
+	// edges with one triangle are borders or attribute seams, edges with more are non-manifold
+	std::vector<uint64_t> edges;
+	edges.reserve(result.size());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+			edges.push_back(edgeKey(result[i + k], result[i + (k + 1) % 3]));
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<bool> locked(numVertices, false);
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+		if (j - i != 2)
+		{
+			locked[static_cast<GLuint>(edges[i] >> 32)] = true;
+			locked[static_cast<GLuint>(edges[i])] = true;
+		}
+		i = j;
+	}
+
+	double maxError = 0.0;
+	std::vector<int> offsets(numVertices + 1);
+	std::vector<int> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(numVertices);
+	std::vector<GLuint> remap(numVertices);
+	std::vector<unsigned int> marks(numVertices, 0);
+	unsigned int mark = 0;
+
+	// each pass applies the cheapest independent collapses
+	while (static_cast<int>(result.size()) > targetIndices)
+	{
+		int numTriangles = static_cast<int>(result.size() / 3);
+
+		// triangles around each vertex
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (GLuint index : result)
+			offsets[index + 1]++;
+		for (int v = 0; v < numVertices; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(result.size());
+		std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+			adjacency[fill[result[i]]++] = static_cast<int>(i / 3);
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint a = result[i + k];
+				GLuint b = result[i + (k + 1) % 3];
+				Quadric q = quadrics[a];
+				q.add(quadrics[b]);
+
+				if (!locked[a])
+					collapses.push_back({ q.evaluate(&positions[b * 3]), a, b });
+				if (!locked[b])
+					collapses.push_back({ q.evaluate(&positions[a * 3]), b, a });
+			}
+		}
+		if (collapses.empty())
+			break;
+
+		// ties are broken by vertex so the result does not depend on the sort
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+		{
+			if (x.cost != y.cost)
+				return x.cost < y.cost;
+			return x.from != y.from ? x.from < y.from : x.to < y.to;
+		});
+
+		// a collapse removes about two triangles
+		int budget = (numTriangles - targetIndices / 3) / 2 + 1;
+		int applied = 0;
+
+		std::fill(touched.begin(), touched.end(), false);
+		for (int v = 0; v < numVertices; v++)
+			remap[v] = static_cast<GLuint>(v);
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (applied >= budget)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// link condition: the one-rings may only share the apexes of the triangles on the edge,
+			// any other shared vertex would fold the surface onto itself or pinch it
+			mark++;
+			for (int a = offsets[collapse.to]; a < offsets[collapse.to + 1]; a++)
+			{
+				for (int k = 0; k < 3; k++)
+					marks[result[adjacency[a] * 3 + k]] = mark;
+			}
+
+			GLuint apexes[2];
+			int numApexes = 0;
+			for (int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+			{
+				const GLuint* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] != collapse.to && triangle[1] != collapse.to && triangle[2] != collapse.to)
+					continue;
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (triangle[k] != collapse.from && triangle[k] != collapse.to && numApexes < 2)
+						apexes[numApexes++] = triangle[k];
+				}
+			}
+
+			bool linked = true;
+			for (int a = offsets[collapse.from]; a < offsets[collapse.from + 1] && linked; a++)
+			{
+				const GLuint* triangle = &result[adjacency[a] * 3];
+				for (int k = 0; k < 3; k++)
+				{
+					GLuint v = triangle[k];
+					if (v != collapse.from && v != collapse.to && marks[v] == mark
+						&& std::find(apexes, apexes + numApexes, v) == apexes + numApexes)
+					{
+						linked = false;
+					}
+				}
+			}
+			if (!linked)
+				continue;
+
+			// reject collapses that flip or flatten a remaining triangle
+			bool valid = true;
+			for (int a = offsets[collapse.from]; a < offsets[collapse.from + 1] && valid; a++)
+			{
+				const GLuint* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+					continue;
+
+				const float* before[3];
+				const float* after[3];
+				for (int k = 0; k < 3; k++)
+				{
+					before[k] = &positions[triangle[k] * 3];
+					after[k] = (triangle[k] == collapse.from) ? &positions[collapse.to * 3] : before[k];
+				}
+
+				double n0[3], n1[3];
+				triangleNormal(before[0], before[1], before[2], n0);
+				triangleNormal(after[0], after[1], after[2], n1);
+				double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+				double length0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+				double length1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+				valid = dot > 0.25 * std::sqrt(length0 * length1);
+			}
+			if (!valid)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.cost);
+			applied++;
+
+			// lock the one-ring so later checks this pass see current geometry
+			for (int a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+			{
+				for (int k = 0; k < 3; k++)
+					touched[result[adjacency[a] * 3 + k]] = true;
+			}
+		}
+
+		if (applied == 0)
+			break;
+
+		// drop triangles that collapsed to a line
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			GLuint a = remap[result[i]];
+			GLuint b = remap[result[i + 1]];
+			GLuint c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	return static_cast<float>(std::sqrt(maxError));
+}
+
+void MeshSimplifier::buildLods(MeshData& data, int numLods, float ratio, int numThreads)
+{
+	// mapped cache files are read only, and levels are only built once
+	if (data.vertices != data.vertexStorage.data() || data.indices != data.indexStorage.data() || data.lodCount() > 1)
+		return;
+
+	// each submesh owns the vertices up to the next base vertex
+	std::vector<int> bases;
+	for (const Submesh& submesh : data.submeshes)
+		bases.push_back(submesh.baseVertex);
+	bases.push_back(data.numVertices);
+	std::sort(bases.begin(), bases.end());
+
+	int numSubmeshes = static_cast<int>(data.submeshes.size());
+	std::vector<std::vector<std::vector<GLuint>>> levels(numLods, std::vector<std::vector<GLuint>>(numSubmeshes));
+	std::vector<std::vector<float>> errors(numLods, std::vector<float>(numSubmeshes, 0.0f));
+
+	Parallel::forRange(0, numSubmeshes, [&](int begin, int end)
+	{
+		std::vector<int> clusterStarts;
+
+		for (int s = begin; s < end; s++)
+		{
+			const Submesh& submesh = data.submeshes[s];
+			int numVertices = *std::upper_bound(bases.begin(), bases.end(), submesh.baseVertex) - submesh.baseVertex;
+			const unsigned char* vertices = data.vertexStorage.data() + static_cast<size_t>(submesh.baseVertex) * data.vertexStride;
+			const GLuint* indices = data.indexStorage.data() + submesh.firstIndex;
+
+			levels[0][s].assign(indices, indices + submesh.numIndices);
+			if (std::any_of(indices, indices + submesh.numIndices, [&](GLuint index) { return index >= static_cast<GLuint>(numVertices); }))
+			{
+				for (int l = 1; l < numLods; l++)
+					levels[l][s] = levels[0][s];
+				continue;
+			}
+
+			// each level simplifies the one before, so the errors add up
+			for (int l = 1; l < numLods; l++)
+			{
+				const std::vector<GLuint>& previous = levels[l - 1][s];
+				int target = static_cast<int>(previous.size() / 3 * ratio) * 3;
+
+				std::vector<GLuint> simplified;
+				errors[l][s] = errors[l - 1][s] + simplify(previous.data(), static_cast<int>(previous.size()), vertices,
+					data.vertexStride, numVertices, target, simplified);
+
+				MeshOptimizer::optimizeVertexCache(simplified.data(), static_cast<int>(simplified.size()), numVertices,
+					levels[l][s], clusterStarts);
+			}
+		}
+	}, 1, numThreads);
+
+	// append the levels that still remove enough triangles
+	data.lodErrors.assign(1, 0.0f);
+	size_t previousSize = static_cast<size_t>(data.numIndices);
+	for (int l = 1; l < numLods; l++)
+	{
+		size_t size = 0;
+		float error = 0.0f;
+		for (int s = 0; s < numSubmeshes; s++)
+		{
+			size += levels[l][s].size();
+			error = std::max(error, errors[l][s]);
+		}
+		if (size > previousSize * 9 / 10)
+			break;
+
+		for (int s = 0; s < numSubmeshes; s++)
+		{
+			Submesh submesh = data.submeshes[s];
+			submesh.firstIndex = static_cast<int>(data.indexStorage.size());
+			submesh.numIndices = static_cast<int>(levels[l][s].size());
+			data.indexStorage.insert(data.indexStorage.end(), levels[l][s].begin(), levels[l][s].end());
+			data.submeshes.push_back(submesh);
+		}
+		data.lodErrors.push_back(error);
+		previousSize = size;
+	}
+
+	data.numIndices = static_cast<int>(data.indexStorage.size());
+	data.useStorage();
+}
@@ -0,0 +1,31 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+
+#include "MeshCache.h"
+
+/*****************************************************************
+ * quadric error edge collapse simplification for level of detail
+ * vertices are collapsed onto neighbouring vertices, so every
+ * level indexes the same vertex buffer. border and seam vertices
+ * are locked so attribute seams do not tear
+ *****************************************************************/
+namespace MeshSimplifier
+{
+	// levels built by default, including the full detail level
+	const int cLodCount = 4;
+	// triangle ratio of each level to the one before
+	const float cLodRatio = 0.5f;
+
+	// simplify a triangle list towards targetIndices, positions are three floats at the start of each vertex
+	// returns the largest collapse error in model units, result may stay above the target when nothing can collapse
+	float simplify(const GLuint* indices, int numIndices, const unsigned char* vertices, int vertexStride, int numVertices,
+		int targetIndices, std::vector<GLuint>& result);
+
+	// append coarser levels of each submesh to mesh data that owns its storage, submeshes are split across threads
+	// levels that do not remove at least a tenth of the triangles are dropped
+	void buildLods(MeshData& data, int numLods = cLodCount, float ratio = cLodRatio, int numThreads = 0);
+}
+
+#endif
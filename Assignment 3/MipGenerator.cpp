@@ -0,0 +1,507 @@
+#include "MipGenerator.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace
+{
+	const int cLanczosTaps = 12;	// Lanczos-3 scaled by 2 for a 2:1 reduction
+	const int cLinearTableSize = 4096;
+
+	// lookup tables for sRGB <-> linear conversion
+	struct ConversionTables
+	{
+		float toLinear[256];
+		float toUnit[256];
+		unsigned char toSRGB[cLinearTableSize];
+
+		ConversionTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				toUnit[i] = c;
+			}
+			for (int i = 0; i < cLinearTableSize; i++)
+			{
+				float l = i / static_cast<float>(cLinearTableSize - 1);
+				float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				toSRGB[i] = static_cast<unsigned char>(std::min(255.0f, c * 255.0f + 0.5f));
+			}
+		}
+	};
+
+	const ConversionTables& tables()
+	{
+		static const ConversionTables instance;
+		return instance;
+	}
+
+	// normalised Lanczos-3 weights for a 2:1 reduction
+	// tap k samples source pixel 2x + k - 5
+	struct LanczosWeights
+	{
+		float w[cLanczosTaps];
+
+		LanczosWeights()
+		{
+			const float pi = 3.14159265358979f;
+			float sum = 0.0f;
+
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				// distance from the output centre in output pixels
+				float d = (k - 5.5f) * 0.5f;
+				float value = 1.0f;
+				if (d != 0.0f)
+					value = 3.0f * std::sin(pi * d) * std::sin(pi * d / 3.0f) / (pi * pi * d * d);
+				w[k] = value;
+				sum += value;
+			}
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				w[k] /= sum;
+			}
+		}
+	};
+
+	const LanczosWeights& lanczosWeights()
+	{
+		static const LanczosWeights instance;
+		return instance;
+	}
+
+	// float RGBA image
+	struct FloatImage
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<float> pixels;
+
+		float* row(int y) { return &pixels[static_cast<size_t>(y) * width * 4]; }
+		const float* row(int y) const { return &pixels[static_cast<size_t>(y) * width * 4]; }
+	};
+
+	// convert a row of RGBA8 or BGR8 pixels to float, decoding sRGB colour channels if requested
+	void toFloatRow(const unsigned char* in, int width, bool bgr, bool srgb, float* out)
+	{
+		const float* colorTable = srgb ? tables().toLinear : tables().toUnit;
+		const float* alphaTable = tables().toUnit;
+
+		for (int x = 0; x < width; x++)
+		{
+			if (bgr)
+			{
+				out[x * 4 + 0] = colorTable[in[x * 3 + 2]];
+				out[x * 4 + 1] = colorTable[in[x * 3 + 1]];
+				out[x * 4 + 2] = colorTable[in[x * 3 + 0]];
+				out[x * 4 + 3] = 1.0f;
+			}
+			else
+			{
+				out[x * 4 + 0] = colorTable[in[x * 4 + 0]];
+				out[x * 4 + 1] = colorTable[in[x * 4 + 1]];
+				out[x * 4 + 2] = colorTable[in[x * 4 + 2]];
+				out[x * 4 + 3] = alphaTable[in[x * 4 + 3]];
+			}
+		}
+	}
+
+	// convert an RGBA8 image to float, decoding sRGB colour channels if requested
+	void toFloat(const unsigned char* source, int width, int height, bool srgb, FloatImage& image)
+	{
+		image.width = width;
+		image.height = height;
+		image.pixels.resize(static_cast<size_t>(width) * height * 4);
+
+		for (int y = 0; y < height; y++)
+		{
+			toFloatRow(source + static_cast<size_t>(y) * width * 4, width, false, srgb, image.row(y));
+		}
+	}
+
+	// convert a float image to an RGBA8 level, encoding sRGB colour channels if requested
+	void toLevel(const FloatImage& image, bool srgb, TextureLevel& level)
+	{
+		level.width = image.width;
+		level.height = image.height;
+		level.data.resize(static_cast<size_t>(image.width) * image.height * 4);
+
+		size_t count = static_cast<size_t>(image.width) * image.height;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				float v = std::min(1.0f, std::max(0.0f, image.pixels[i * 4 + c]));
+
+				if (srgb && c < 3)
+					level.data[i * 4 + c] = tables().toSRGB[static_cast<int>(v * (cLinearTableSize - 1) + 0.5f)];
+				else
+					level.data[i * 4 + c] = static_cast<unsigned char>(v * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	/*****************************************************************
+	 * box filter kernels
+	 *****************************************************************/
+	// generic kernel, handles clamping at odd edges
+	void boxRowGeneric(const float* row0, const float* row1, float* out, int outWidth, int srcWidth, int xBegin)
+	{
+		for (int x = xBegin; x < outWidth; x++)
+		{
+			int x0 = std::min(x * 2, srcWidth - 1) * 4;
+			int x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+#if defined(SIMD_SSE2)
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+				_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+			_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+			for (int c = 0; c < 4; c++)
+			{
+				out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+			}
+#endif
+		}
+	}
+
+#if defined(SIMD_SSE2)
+	// two output pixels per iteration from four source pixels of each row
+	SIMD_TARGET_AVX2 int boxRowAVX2(const float* row0, const float* row1, float* out, int outWidth, int srcWidth)
+	{
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		int x = 0;
+
+		// all four source pixels must be inside the row
+		for (; x + 1 < outWidth && x * 2 + 3 < srcWidth; x += 2)
+		{
+			__m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+			__m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+
+			// [p0 p2] + [p1 p3]
+			__m256 even = _mm256_permute2f128_ps(a, b, 0x20);
+			__m256 odd = _mm256_permute2f128_ps(a, b, 0x31);
+			_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), quarter));
+		}
+
+		return x;
+	}
+#endif
+
+	void boxDownsample(const FloatImage& source, FloatImage& target)
+	{
+		target.width = std::max(1, source.width / 2);
+		target.height = std::max(1, source.height / 2);
+		target.pixels.resize(static_cast<size_t>(target.width) * target.height * 4);
+
+		bool avx2 = Simd::hasAVX2();
+
+		Parallel::forRange(0, target.height, [&](int yBegin, int yEnd)
+		{
+			for (int y = yBegin; y < yEnd; y++)
+			{
+				const float* row0 = source.row(std::min(y * 2, source.height - 1));
+				const float* row1 = source.row(std::min(y * 2 + 1, source.height - 1));
+				float* out = target.row(y);
+
+				int x = 0;
+#if defined(SIMD_SSE2)
+				if (avx2)
+					x = boxRowAVX2(row0, row1, out, target.width, source.width);
+#endif
+				boxRowGeneric(row0, row1, out, target.width, source.width, x);
+			}
+		}, 16);
+	}
+
+	/*****************************************************************
+	 * Lanczos filter kernels
+	 *****************************************************************/
+	// horizontal pass, one output pixel per iteration
+	void lanczosRow(const float* row, float* out, int outWidth, int srcWidth)
+	{
+		const float* w = lanczosWeights().w;
+
+		for (int x = 0; x < outWidth; x++)
+		{
+#if defined(SIMD_SSE2)
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				int sx = std::min(std::max(x * 2 + k - 5, 0), srcWidth - 1);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), _mm_set1_ps(w[k])));
+			}
+			_mm_storeu_ps(out + x * 4, sum);
+#else
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				int sx = std::min(std::max(x * 2 + k - 5, 0), srcWidth - 1);
+				for (int c = 0; c < 4; c++)
+				{
+					sum[c] += row[sx * 4 + c] * w[k];
+				}
+			}
+			for (int c = 0; c < 4; c++)
+			{
+				out[x * 4 + c] = sum[c];
+			}
+#endif
+		}
+	}
+
+	// vertical pass over contiguous floats of the source rows
+	void lanczosColumnGeneric(const float* const* rows, float* out, int numFloats, int begin)
+	{
+		const float* w = lanczosWeights().w;
+
+		for (int i = begin; i < numFloats; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				sum += rows[k][i] * w[k];
+			}
+			out[i] = sum;
+		}
+	}
+
+#if defined(SIMD_SSE2)
+	// eight floats (two pixels) per iteration
+	SIMD_TARGET_AVX2 int lanczosColumnAVX2(const float* const* rows, float* out, int numFloats)
+	{
+		const float* w = lanczosWeights().w;
+		int i = 0;
+
+		for (; i + 8 <= numFloats; i += 8)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				sum = _mm256_fmadd_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(w[k]), sum);
+			}
+			_mm256_storeu_ps(out + i, sum);
+		}
+
+		return i;
+	}
+
+	// four floats (one pixel) per iteration
+	int lanczosColumnSSE(const float* const* rows, float* out, int numFloats)
+	{
+		const float* w = lanczosWeights().w;
+		int i = 0;
+
+		for (; i + 4 <= numFloats; i += 4)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < cLanczosTaps; k++)
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(w[k])));
+			}
+			_mm_storeu_ps(out + i, sum);
+		}
+
+		return i;
+	}
+#endif
+
+	void lanczosDownsample(const FloatImage& source, FloatImage& target)
+	{
+		target.width = std::max(1, source.width / 2);
+		target.height = std::max(1, source.height / 2);
+		target.pixels.resize(static_cast<size_t>(target.width) * target.height * 4);
+
+		// horizontal pass into an intermediate image of source height
+		FloatImage horizontal;
+		horizontal.width = target.width;
+		horizontal.height = source.height;
+		horizontal.pixels.resize(static_cast<size_t>(horizontal.width) * horizontal.height * 4);
+
+		Parallel::forRange(0, source.height, [&](int yBegin, int yEnd)
+		{
+			for (int y = yBegin; y < yEnd; y++)
+			{
+				if (source.width == 1)
+					std::copy(source.row(y), source.row(y) + 4, horizontal.row(y));
+				else
+					lanczosRow(source.row(y), horizontal.row(y), target.width, source.width);
+			}
+		}, 16);
+
+		// vertical pass
+		bool avx2 = Simd::hasAVX2();
+		int numFloats = target.width * 4;
+
+		Parallel::forRange(0, target.height, [&](int yBegin, int yEnd)
+		{
+			for (int y = yBegin; y < yEnd; y++)
+			{
+				if (source.height == 1)
+				{
+					std::copy(horizontal.row(0), horizontal.row(0) + numFloats, target.row(y));
+					continue;
+				}
+
+				const float* rows[cLanczosTaps];
+				for (int k = 0; k < cLanczosTaps; k++)
+				{
+					rows[k] = horizontal.row(std::min(std::max(y * 2 + k - 5, 0), source.height - 1));
+				}
+
+				int i = 0;
+#if defined(SIMD_SSE2)
+				if (avx2)
+					i = lanczosColumnAVX2(rows, target.row(y), numFloats);
+				else
+					i = lanczosColumnSSE(rows, target.row(y), numFloats);
+#endif
+				lanczosColumnGeneric(rows, target.row(y), numFloats, i);
+			}
+		}, 16);
+	}
+}
+
+int MipGenerator::levelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		levels++;
+	}
+	return levels;
+}
+
+namespace
+{
+	// filter level 1 of a BGR8 image with padded rows straight from its bytes
+	// each band of output rows converts only the source rows it reads, so no full resolution float copy is made
+	void downsampleBGR(const unsigned char* bgr, int width, int height, int rowStride, MipFilter filter, bool srgb,
+		FloatImage& target)
+	{
+		target.width = std::max(1, width / 2);
+		target.height = std::max(1, height / 2);
+		target.pixels.resize(static_cast<size_t>(target.width) * target.height * 4);
+
+		bool avx2 = Simd::hasAVX2();
+		auto sourceRow = [&](int y) { return bgr + static_cast<size_t>(std::min(std::max(y, 0), height - 1)) * rowStride; };
+
+		Parallel::forRange(0, target.height, [&](int yBegin, int yEnd)
+		{
+			std::vector<float> row0(static_cast<size_t>(width) * 4);
+
+			if (filter != MipFilter::Lanczos)
+			{
+				std::vector<float> row1(row0.size());
+				for (int y = yBegin; y < yEnd; y++)
+				{
+					toFloatRow(sourceRow(y * 2), width, true, srgb, row0.data());
+					toFloatRow(sourceRow(y * 2 + 1), width, true, srgb, row1.data());
+					float* out = target.row(y);
+
+					int x = 0;
+#if defined(SIMD_SSE2)
+					if (avx2)
+						x = boxRowAVX2(row0.data(), row1.data(), out, target.width, width);
+#endif
+					boxRowGeneric(row0.data(), row1.data(), out, target.width, width, x);
+				}
+				return;
+			}
+
+			// ring of horizontally filtered rows, source row r is held in slot r mod the tap count
+			// consecutive output rows share ten of their twelve source rows, so each is filtered once per band
+			int numFloats = target.width * 4;
+			std::vector<float> ring(static_cast<size_t>(cLanczosTaps) * numFloats);
+			int ringRows[cLanczosTaps];
+			std::fill(ringRows, ringRows + cLanczosTaps, INT_MIN);
+
+			for (int y = yBegin; y < yEnd; y++)
+			{
+				const float* rows[cLanczosTaps];
+				for (int k = 0; k < cLanczosTaps; k++)
+				{
+					int r = y * 2 + k - 5;
+					int slot = ((r % cLanczosTaps) + cLanczosTaps) % cLanczosTaps;
+					float* filtered = &ring[static_cast<size_t>(slot) * numFloats];
+
+					if (ringRows[slot] != r)
+					{
+						toFloatRow(sourceRow(r), width, true, srgb, row0.data());
+						lanczosRow(row0.data(), filtered, target.width, width);
+						ringRows[slot] = r;
+					}
+					rows[k] = filtered;
+				}
+
+				int i = 0;
+#if defined(SIMD_SSE2)
+				if (avx2)
+					i = lanczosColumnAVX2(rows, target.row(y), numFloats);
+				else
+					i = lanczosColumnSSE(rows, target.row(y), numFloats);
+#endif
+				lanczosColumnGeneric(rows, target.row(y), numFloats, i);
+			}
+		}, 16);
+	}
+
+	// build the levels after first from the float image of that level
+	void generateLevels(FloatImage& current, MipFilter filter, bool srgb, std::vector<TextureLevel>& levels,
+		size_t first = 0)
+	{
+		FloatImage next;
+
+		for (size_t i = first + 1; i < levels.size(); i++)
+		{
+			if (filter == MipFilter::Lanczos)
+				lanczosDownsample(current, next);
+			else
+				boxDownsample(current, next);
+
+			toLevel(next, srgb, levels[i]);
+			std::swap(current, next);
+		}
+	}
+}
+
+void MipGenerator::generate(const unsigned char* rgba, int width, int height, MipFilter filter, bool srgb,
+	std::vector<TextureLevel>& levels)
+{
+	levels.resize(levelCount(width, height));
+
+	// level 0 is the source image
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].data.assign(rgba, rgba + static_cast<size_t>(width) * height * 4);
+
+	// each level is filtered from the previous one in float
+	FloatImage base;
+	toFloat(rgba, width, height, srgb, base);
+	generateLevels(base, filter, srgb, levels);
+}
+
+void MipGenerator::generateBGR(const unsigned char* bgr, int width, int height, int rowStride, MipFilter filter,
+	bool srgb, std::vector<TextureLevel>& levels)
+{
+	levels.resize(levelCount(width, height));
+
+	// level 0 pixels stay with the caller
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].data.clear();
+	if (levels.size() == 1)
+		return;
+
+	// level 1 is filtered from the bytes, the rest from level 1 in float as usual
+	FloatImage current;
+	downsampleBGR(bgr, width, height, rowStride, filter, srgb, current);
+	toLevel(current, srgb, levels[1]);
+	generateLevels(current, filter, srgb, levels, 1);
+}
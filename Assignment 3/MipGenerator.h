@@ -0,0 +1,36 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <vector>
+
+#include "TextureCache.h"
+
+// downsampling filter used to build mip levels
+enum class MipFilter
+{
+	Box,		// 2x2 average
+	Lanczos		// separable Lanczos-3, sharper with less aliasing
+};
+
+/*****************************************************************
+ * CPU mip chain generation with SSE/AVX2 kernels
+ * levels are filtered in linear float space, rows are split
+ * across threads
+ *****************************************************************/
+namespace MipGenerator
+{
+	// number of levels in a full mip chain
+	int levelCount(int width, int height);
+
+	// build the full mip chain of an RGBA8 image, levels[0] is a copy of the source
+	// srgb averages the colour channels in linear light (alpha is always linear)
+	void generate(const unsigned char* rgba, int width, int height, MipFilter filter, bool srgb,
+		std::vector<TextureLevel>& levels);
+	// build levels 1 and up of a BGR8 image with padded rows (e.g. a bitmap file)
+	// levels[0] only gets its size, the caller supplies the base level pixels
+	// level 1 is filtered from the bytes a few rows at a time, so no full resolution float copy is made
+	void generateBGR(const unsigned char* bgr, int width, int height, int rowStride, MipFilter filter, bool srgb,
+		std::vector<TextureLevel>& levels);
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*****************************************************************
+ * split a range of work items across threads
+ * fn(begin, end) is called once per contiguous chunk. chunks run
+ * on a pool of threads started on first use, a range split from
+ * inside a pool thread runs serially on that thread
+ *****************************************************************/
+namespace Parallel
+{
+	// number of worker threads to use by default
+	inline int threadCount()
+	{
+		return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	// persistent worker threads, the thread that splits a range works alongside them
+	class Pool
+	{
+	public:
+		// the shared pool, one worker less than the thread count
+		static Pool& instance()
+		{
+			static Pool pool(threadCount() - 1);
+			return pool;
+		}
+
+		// true on the pool's own threads
+		static bool& isWorker()
+		{
+			thread_local bool worker = false;
+			return worker;
+		}
+
+		~Pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStop = true;
+			}
+			mWake.notify_all();
+			for (std::thread& thread : mThreads)
+			{
+				thread.join();
+			}
+		}
+
+		void submit(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mTasks.push_back(std::move(task));
+			}
+			mWake.notify_one();
+		}
+
+		// run one queued task on the calling thread, returns false if there was none
+		bool runOne()
+		{
+			std::function<void()> task;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if (mTasks.empty())
+					return false;
+				task = std::move(mTasks.front());
+				mTasks.pop_front();
+			}
+			task();
+			return true;
+		}
+
+	private:
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::deque<std::function<void()>> mTasks;
+		std::vector<std::thread> mThreads;
+		bool mStop = false;
+
+		Pool(int numThreads)
+		{
+			for (int i = 0; i < numThreads; i++)
+			{
+				mThreads.emplace_back([this]() { run(); });
+			}
+		}
+
+		void run()
+		{
+			isWorker() = true;
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					mWake.wait(lock, [this]() { return mStop || !mTasks.empty(); });
+					if (mTasks.empty())
+						return;
+					task = std::move(mTasks.front());
+					mTasks.pop_front();
+				}
+				task();
+			}
+		}
+	};
+
+	// run fn over [begin, end) in chunks of at least minChunk items
+	template <typename Function>
+	void forRange(int begin, int end, Function fn, int minChunk = 1, int numThreads = 0)
+	{
+		int count = end - begin;
+		if (count <= 0)
+			return;
+
+		if (numThreads <= 0)
+			numThreads = threadCount();
+		numThreads = std::min(numThreads, std::max(1, count / std::max(1, minChunk)));
+
+		// not worth splitting, or already on a pool thread
+		if (numThreads == 1 || Pool::isWorker())
+		{
+			fn(begin, end);
+			return;
+		}
+
+		// the calling thread takes the first chunk, then runs queued chunks until its own are done
+		std::mutex mutex;
+		std::condition_variable finished;
+		int chunk = (count + numThreads - 1) / numThreads;
+		int remaining = (count - 1) / chunk;
+		for (int start = begin + chunk; start < end; start += chunk)
+		{
+			int stop = std::min(start + chunk, end);
+			Pool::instance().submit([&, start, stop]()
+			{
+				fn(start, stop);
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--remaining == 0)
+					finished.notify_one();
+			});
+		}
+		fn(begin, std::min(begin + chunk, end));
+
+		for (;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (remaining == 0)
+					return;
+			}
+			if (!Pool::instance().runOne())
+				break;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&]() { return remaining == 0; });
+	}
+}
+
+#endif
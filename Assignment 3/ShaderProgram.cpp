@@ -165,6 +165,11 @@ void ShaderProgram::setUniform(const char *name, const glm::vec3& vector)
 	glUniform3fv(getUniformLocation(name), 1, &vector[0]);
 }
 
+void ShaderProgram::setUniform(const char *name, const glm::vec3* vectors, int count)
+{
+	glUniform3fv(getUniformLocation(name), count, &vectors[0][0]);
+}
+
 void ShaderProgram::setUniform(const char *name, const glm::vec4& vector)
 {
 	glUniform4fv(getUniformLocation(name), 1, &vector[0]);
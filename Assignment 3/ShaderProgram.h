@@ -23,6 +23,7 @@ public:
 	// functions to set shader uniform variables
 	void setUniform(const char *name, const glm::vec2& vector);
 	void setUniform(const char *name, const glm::vec3& vector);
+	void setUniform(const char *name, const glm::vec3* vectors, int count);	// array, name is the array's first element
 	void setUniform(const char *name, const glm::vec4& vector);
 	void setUniform(const char* name, const glm::mat3& matrix);
 	void setUniform(const char *name, const glm::mat4& matrix);
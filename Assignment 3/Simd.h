@@ -0,0 +1,61 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*****************************************************************
+ * SIMD support
+ * SSE2 is assumed on x86/x64, AVX2 kernels are compiled with a
+ * function target attribute and selected at runtime
+ *****************************************************************/
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SIMD_SSE2 1
+#include <immintrin.h>
+#endif
+
+#if defined(SIMD_SSE2) && defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#elif defined(SIMD_SSE2)
+#include <cpuid.h>
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace Simd
+{
+	// whether the CPU and OS support AVX2 and FMA
+	inline bool hasAVX2()
+	{
+#if defined(SIMD_SSE2)
+		static const bool supported = []()
+		{
+			int info[4] = {};
+#if defined(_MSC_VER)
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool fma = (info[2] & (1 << 12)) != 0;
+			if (!osxsave || !fma || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(info, 7, 0);
+#else
+			unsigned int a, b, c, d;
+			__cpuid(1, a, b, c, d);
+			bool osxsave = (c & (1 << 27)) != 0;
+			bool fma = (c & (1 << 12)) != 0;
+			if (!osxsave || !fma)
+				return false;
+			unsigned int xcr0Low, xcr0High;
+			__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+			if ((xcr0Low & 6) != 6)
+				return false;
+			__cpuid_count(7, 0, a, b, c, d);
+			info[1] = static_cast<int>(b);
+#endif
+			return (info[1] & (1 << 5)) != 0;
+		}();
+		return supported;
+#else
+		return false;
+#endif
+	}
+}
+
+#endif
@@ -1,4 +1,119 @@
 #include "SimpleModel.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+namespace
+{
+	// grow bounds to contain a position
+	void growBounds(MeshData& data, const GLfloat position[3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			data.boundsMin[i] = std::min(data.boundsMin[i], position[i]);
+			data.boundsMax[i] = std::max(data.boundsMax[i], position[i]);
+		}
+	}
+
+	// copy interleaved vertices into the mesh data
+	template <typename Vertex>
+	void setVertices(MeshData& data, const std::vector<Vertex>& vertices)
+	{
+		data.vertexStride = sizeof(Vertex);
+		data.numVertices = static_cast<int>(vertices.size());
+		data.vertexStorage.resize(vertices.size() * sizeof(Vertex));
+		if (!vertices.empty())
+			std::memcpy(data.vertexStorage.data(), vertices.data(), data.vertexStorage.size());
+
+		for (int i = 0; i < 3; i++)
+		{
+			data.boundsMin[i] = vertices.empty() ? 0.0f : vertices[0].position[i];
+			data.boundsMax[i] = data.boundsMin[i];
+		}
+		for (const Vertex& vertex : vertices)
+			growBounds(data, vertex.position);
+	}
+
+	// quantize a value within [min, min + extent] to a 16-bit normalized integer
+	GLushort unorm16(float value, float min, float extent)
+	{
+		float t = (extent > 0.0f) ? (value - min) / extent : 0.0f;
+		return static_cast<GLushort>(std::lround(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f));
+	}
+
+	// octahedral encoding of a unit vector as two 16-bit signed normalized integers
+	void octahedralEncode(const GLfloat normal[3], GLshort encoded[2])
+	{
+		float sum = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		float x = (sum > 0.0f) ? normal[0] / sum : 0.0f;
+		float y = (sum > 0.0f) ? normal[1] / sum : 0.0f;
+
+		// fold the lower hemisphere over the diagonals
+		if (normal[2] < 0.0f)
+		{
+			float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		encoded[0] = static_cast<GLshort>(std::lround(x * 32767.0f));
+		encoded[1] = static_cast<GLshort>(std::lround(y * 32767.0f));
+	}
+
+	// decode uniform locations of a shader program
+	struct DecodeLocations
+	{
+		GLint quantized;
+		GLint positionMin;
+		GLint positionExtent;
+		GLint texCoordMin;
+		GLint texCoordExtent;
+	};
+
+	// set the quantized decode uniforms of the current program, shaders without them ignore the calls
+	void setDecodeUniforms(const Mesh& mesh, bool quantized)
+	{
+		static std::map<GLuint, DecodeLocations> sLocations;
+
+		GLint program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		if (program == 0)
+			return;
+
+		auto found = sLocations.find(program);
+		if (found == sLocations.end())
+		{
+			DecodeLocations locations;
+			locations.quantized = glGetUniformLocation(program, "uQuantized");
+			locations.positionMin = glGetUniformLocation(program, "uPositionMin");
+			locations.positionExtent = glGetUniformLocation(program, "uPositionExtent");
+			locations.texCoordMin = glGetUniformLocation(program, "uTexCoordMin");
+			locations.texCoordExtent = glGetUniformLocation(program, "uTexCoordExtent");
+			found = sLocations.emplace(program, locations).first;
+		}
+
+		const DecodeLocations& locations = found->second;
+		glUniform1i(locations.quantized, quantized ? 1 : 0);
+		if (quantized)
+		{
+			glUniform3fv(locations.positionMin, 1, mesh.positionMin);
+			glUniform3fv(locations.positionExtent, 1, mesh.positionExtent);
+			glUniform2fv(locations.texCoordMin, 1, mesh.texCoordMin);
+			glUniform2fv(locations.texCoordExtent, 1, mesh.texCoordExtent);
+		}
+	}
+}
+
+const float SimpleModel::cLodPixelError = 1.0f;
+const float SimpleModel::cLodHysteresis = 0.5f;
+
+int SimpleModel::sTrianglesDrawn = 0;
+int SimpleModel::sFullDetailTriangles = 0;
 
 SimpleModel::SimpleModel()
 {}
@@ -16,8 +131,21 @@ SimpleModel::~SimpleModel()
 	mIsValid = false;
 }
 
-void SimpleModel::loadModel(const char *filename, bool texture)
+void SimpleModel::loadModel(const char *filename, bool texture, bool quantized)
 {
+	mQuantized = quantized;
+
+	// imported meshes are cached, later runs map the final vertices and indices instead of importing
+	MeshData data;
+	uint64_t key = 0;
+	bool cacheable = MeshCache::makeKey(filename, texture, key);
+
+	if (cacheable && MeshCache::load(key, data))
+	{
+		upload(data);
+		return;
+	}
+
 	// Create an instance of the Importer class
 	Assimp::Importer importer;
 
@@ -35,36 +163,179 @@ void SimpleModel::loadModel(const char *filename, bool texture)
 		exit(EXIT_FAILURE);
 	}
 
-	// only loads first mesh
-	if(!texture)
-		loadMesh(scene->mMeshes[0]);
+	// append every mesh of the scene to one vertex and index array, one submesh per mesh
+	std::vector<VertexNormal> vertices;
+	std::vector<VertexNormTex> texVertices;
+	std::vector<GLuint> indices;
+	data.hasTexCoords = false;
+	data.submeshes.clear();
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+
+		Submesh submesh;
+		submesh.baseVertex = static_cast<int>(texture ? texVertices.size() : vertices.size());
+		submesh.firstIndex = static_cast<int>(indices.size());
+		submesh.materialIndex = static_cast<int>(mesh->mMaterialIndex);
+
+		bool loaded;
+		if(!texture)
+			loaded = loadMesh(mesh, vertices, indices);
+		else
+			loaded = loadMeshWithTexture(mesh, texVertices, indices);
+
+		// meshes without positions, normals or triangles are skipped
+		submesh.numIndices = static_cast<int>(indices.size()) - submesh.firstIndex;
+		if (!loaded || submesh.numIndices == 0)
+			continue;
+
+		data.hasTexCoords = data.hasTexCoords || (texture && mesh->HasTextureCoords(0));
+		data.submeshes.push_back(submesh);
+	}
+
+	if (data.submeshes.empty())
+	{
+		mIsValid = false;
+		return;
+	}
+
+	// keep the interleaved vertices and indices for upload and the mesh cache
+	if (!texture)
+		setVertices(data, vertices);
 	else
-		loadMeshWithTexture(scene->mMeshes[0]);
+		setVertices(data, texVertices);
+	data.numIndices = static_cast<int>(indices.size());
+	data.indexStorage = std::move(indices);
+	data.useStorage();
+
+	// reorder for the vertex cache, overdraw and vertex fetch before caching so later loads get the optimized order
+	VertexCacheStats before, after;
+	MeshOptimizer::optimize(data, before, after);
+	std::cout << "Optimized " << filename << ": " << after.numTriangles << " triangles, ACMR "
+		<< before.acmr() << " -> " << after.acmr() << ", ATVR " << before.atvr() << " -> " << after.atvr() << std::endl;
+
+	// coarser levels share the vertices and are appended to the indices
+	MeshSimplifier::buildLods(data);
+	int perLod = static_cast<int>(data.submeshes.size()) / data.lodCount();
+	for (int l = 1; l < data.lodCount(); l++)
+	{
+		int triangles = 0;
+		for (int s = l * perLod; s < (l + 1) * perLod; s++)
+			triangles += data.submeshes[s].numIndices / 3;
+		std::cout << "  LOD " << l << ": " << triangles << " triangles, error " << data.lodErrors[l] << std::endl;
+	}
+
+	if (cacheable)
+		MeshCache::store(key, data);
+	upload(data);
 
 	// importer's destructor will clean up
 }
 
-void SimpleModel::drawModel()
+glm::vec3 SimpleModel::getBoundsMin() const
+{
+	return glm::vec3(mBoundsMin[0], mBoundsMin[1], mBoundsMin[2]);
+}
+
+glm::vec3 SimpleModel::getBoundsMax() const
+{
+	return glm::vec3(mBoundsMax[0], mBoundsMax[1], mBoundsMax[2]);
+}
+
+float SimpleModel::projectedSize(const glm::mat4& modelViewProjection, float viewportHeight) const
+{
+	glm::vec3 boundsMin = getBoundsMin();
+	glm::vec3 boundsMax = getBoundsMax();
+	glm::vec3 centre = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+	// centres behind the eye are treated as filling the viewport
+	glm::vec4 clip = modelViewProjection * glm::vec4(centre, 1.0f);
+	if (clip.w <= 0.0f)
+		return viewportHeight;
+
+	// the clip space y row scales model units, clip space spans two units of the viewport
+	glm::vec3 row(modelViewProjection[0][1], modelViewProjection[1][1], modelViewProjection[2][1]);
+	return radius * glm::length(row) / clip.w * viewportHeight * 0.5f;
+}
+
+int SimpleModel::selectLod(float projectedSize, int view)
+{
+	int numLods = static_cast<int>(mMesh.lodErrors.size());
+	if (projectedSize < 0.0f || numLods <= 1)
+		return 0;
+
+	float radius = glm::length(getBoundsMax() - getBoundsMin()) * 0.5f;
+	if (radius <= 0.0f)
+		return 0;
+
+	// errors are in model units, scaled to pixels by the projected radius
+	float pixelsPerUnit = projectedSize / radius;
+	int& lod = mLods[std::min(std::max(view, 0), cMaxViews - 1)];
+	lod = std::min(lod, numLods - 1);
+
+	// move finer as soon as the error is visible, coarser only once the next level is well below the limit
+	while (lod > 0 && mMesh.lodErrors[lod] * pixelsPerUnit > cLodPixelError)
+		lod--;
+	while (lod + 1 < numLods && mMesh.lodErrors[lod + 1] * pixelsPerUnit <= cLodPixelError * cLodHysteresis)
+		lod++;
+
+	return lod;
+}
+
+void SimpleModel::resetCounts()
+{
+	sTrianglesDrawn = 0;
+	sFullDetailTriangles = 0;
+}
+
+int SimpleModel::getTrianglesDrawn()
+{
+	return sTrianglesDrawn;
+}
+
+int SimpleModel::getFullDetailTriangles()
+{
+	return sFullDetailTriangles;
+}
+
+void SimpleModel::drawModel(float projectedSize, int view)
 {
 	if (mIsValid)
 	{
 		glBindVertexArray(mMesh.VAO);		// make mesh VAO active
-		glDrawElements(GL_TRIANGLES, mMesh.numOfIndices, GL_UNSIGNED_INT, 0);	// render vertices
+
+		// quantized vertices are decoded with the mesh's ranges for this draw only
+		if (mMesh.quantized)
+			setDecodeUniforms(mMesh, true);
+
+		// render each submesh from the shared buffers, indices are relative to the submesh's base vertex
+		// only the submeshes of the selected level are drawn
+		size_t indexSize = (mMesh.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+		int perLod = static_cast<int>(mMesh.submeshes.size()) / std::max(1, static_cast<int>(mMesh.lodErrors.size()));
+		int lod = selectLod(projectedSize, view);
+		for (int s = lod * perLod; s < (lod + 1) * perLod; s++)
+		{
+			const Submesh& submesh = mMesh.submeshes[s];
+			glDrawElementsBaseVertex(GL_TRIANGLES, submesh.numIndices, mMesh.indexType,
+				reinterpret_cast<void*>(static_cast<size_t>(submesh.firstIndex) * indexSize), submesh.baseVertex);
+
+			sTrianglesDrawn += submesh.numIndices / 3;
+			sFullDetailTriangles += mMesh.submeshes[s - lod * perLod].numIndices / 3;
+		}
+
+		// other geometry drawn with the program is not quantized
+		if (mMesh.quantized)
+			setDecodeUniforms(mMesh, false);
 	}
 }
 
-void SimpleModel::loadMesh(const aiMesh *mesh)
+bool SimpleModel::loadMesh(const aiMesh *mesh, std::vector<VertexNormal>& vertices, std::vector<GLuint>& indices)
 {
-	// mesh data
-	std::vector<VertexNormal> vertices;
-	std::vector<GLint> indices;
-
 	// check if mesh contains vertex coordinates, normals and faces
 	if (!mesh->HasPositions() || !mesh->HasNormals() || !mesh->HasFaces())
-	{
-		mIsValid = false;
-		return;
-	}
+		return false;
 
 	// get vertex data
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -85,64 +356,30 @@ void SimpleModel::loadMesh(const aiMesh *mesh)
 		vertices.push_back(vertex);
 	}
 
-	// get face data
+	// get face data, points and lines left by triangulation are not drawn
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
+		if (mesh->mFaces[i].mNumIndices != 3)
+			continue;
+
+		for (unsigned int j = 0; j < 3; j++)
 		{
 			// append face index
 			indices.push_back(mesh->mFaces[i].mIndices[j]);
 		}
 	}
 
-	// store total number of indices
-	mMesh.numOfIndices = static_cast<int>(indices.size());
-
-	// generate identifier for VBOs and copy data to GPU
-	glGenBuffers(1, &mMesh.VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(VertexNormal) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
-
-	// generate identifier for IBO and copy data to GPU
-	glGenBuffers(1, &mMesh.IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint) * indices.size(), &indices[0], GL_STATIC_DRAW);
-
-	// generate identifiers for VAO and supply information
-	glGenVertexArrays(1, &mMesh.VAO);
-	glBindVertexArray(mMesh.VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, position)));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, normal)));
-
-	// enable vertex attributes
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-
-	// unbind VAO
-	glBindVertexArray(0);
-
-	mIsValid = true;
+	return true;
 }
 
-void SimpleModel::loadMeshWithTexture(const aiMesh* mesh)
+bool SimpleModel::loadMeshWithTexture(const aiMesh* mesh, std::vector<VertexNormTex>& vertices, std::vector<GLuint>& indices)
 {
-	// mesh data
-	std::vector<VertexNormTex> vertices;
-	std::vector<GLint> indices;
-
 	// check if mesh contains vertex coordinates, normals and faces
 	if (!mesh->HasPositions() || !mesh->HasNormals() || !mesh->HasFaces())
-	{
-		mIsValid = false;
-		return;
-	}
+		return false;
+
 	// check if mesh contains texture coordinates (i.e. index 0)
-	if (mesh->HasTextureCoords(0))
-	{
-		mMesh.hasTexCoords = true;
-	}
+	bool hasTexCoords = mesh->HasTextureCoords(0);
 
 	// get vertex data
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -160,7 +397,7 @@ void SimpleModel::loadMeshWithTexture(const aiMesh* mesh)
 		vertex.normal[2] = mesh->mNormals[i].z;
 
 		// get first vertex texture coordinate (i.e. index 0)
-		if (mMesh.hasTexCoords)
+		if (hasTexCoords)
 		{
 			vertex.texCoord[0] = mesh->mTextureCoords[0][i].x;
 			vertex.texCoord[1] = mesh->mTextureCoords[0][i].y;
@@ -174,42 +411,158 @@ void SimpleModel::loadMeshWithTexture(const aiMesh* mesh)
 		vertices.push_back(vertex);
 	}
 
-	// get face data
+	// get face data, points and lines left by triangulation are not drawn
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
+		if (mesh->mFaces[i].mNumIndices != 3)
+			continue;
+
+		for (unsigned int j = 0; j < 3; j++)
 		{
 			// append face index
 			indices.push_back(mesh->mFaces[i].mIndices[j]);
 		}
 	}
 
-	// store total number of indices
-	mMesh.numOfIndices = indices.size();
+	return true;
+}
+
+void SimpleModel::quantizeVertices(const MeshData& data, std::vector<unsigned char>& vertices)
+{
+	bool texCoords = data.vertexStride == sizeof(VertexNormTex);
+	int stride = texCoords ? sizeof(VertexQuantizedNormTex) : sizeof(VertexQuantizedNormal);
+
+	// positions are quantized within the bounds, texture coordinates within their own range
+	float texCoordMin[2] = {};
+	float texCoordMax[2] = {};
+	for (int v = 0; v < data.numVertices && texCoords; v++)
+	{
+		GLfloat texCoord[2];
+		std::memcpy(texCoord, data.vertices + static_cast<size_t>(v) * data.vertexStride + offsetof(VertexNormTex, texCoord), sizeof(texCoord));
+		for (int i = 0; i < 2; i++)
+		{
+			texCoordMin[i] = (v == 0) ? texCoord[i] : std::min(texCoordMin[i], texCoord[i]);
+			texCoordMax[i] = (v == 0) ? texCoord[i] : std::max(texCoordMax[i], texCoord[i]);
+		}
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		mMesh.positionMin[i] = data.boundsMin[i];
+		mMesh.positionExtent[i] = data.boundsMax[i] - data.boundsMin[i];
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		mMesh.texCoordMin[i] = texCoordMin[i];
+		mMesh.texCoordExtent[i] = texCoordMax[i] - texCoordMin[i];
+	}
+
+	vertices.assign(static_cast<size_t>(stride) * data.numVertices, 0);
+	for (int v = 0; v < data.numVertices; v++)
+	{
+		const unsigned char* source = data.vertices + static_cast<size_t>(v) * data.vertexStride;
+		VertexQuantizedNormTex vertex = {};
+
+		GLfloat position[3];
+		GLfloat normal[3];
+		std::memcpy(position, source + offsetof(VertexNormal, position), sizeof(position));
+		std::memcpy(normal, source + offsetof(VertexNormal, normal), sizeof(normal));
+
+		for (int i = 0; i < 3; i++)
+			vertex.position[i] = unorm16(position[i], mMesh.positionMin[i], mMesh.positionExtent[i]);
+
+		octahedralEncode(normal, vertex.normal);
+
+		if (texCoords)
+		{
+			GLfloat texCoord[2];
+			std::memcpy(texCoord, source + offsetof(VertexNormTex, texCoord), sizeof(texCoord));
+			for (int i = 0; i < 2; i++)
+				vertex.texCoord[i] = unorm16(texCoord[i], mMesh.texCoordMin[i], mMesh.texCoordExtent[i]);
+		}
+
+		// the layouts share their prefix, VertexQuantizedNormal stops before texCoord
+		std::memcpy(vertices.data() + static_cast<size_t>(v) * stride, &vertex, stride);
+	}
+}
+
+void SimpleModel::upload(const MeshData& data)
+{
+	// store total number of indices and the bounds
+	mMesh.numOfIndices = data.numIndices;
+	mMesh.hasTexCoords = data.hasTexCoords;
+	mMesh.submeshes = data.submeshes;
+	mMesh.lodErrors = data.lodErrors;
+	mMesh.quantized = mQuantized;
+	std::copy(data.boundsMin, data.boundsMin + 3, mBoundsMin);
+	std::copy(data.boundsMax, data.boundsMax + 3, mBoundsMax);
+
+	// meshes imported with texture coordinates are VertexNormTex, others VertexNormal
+	bool texCoords = data.vertexStride == sizeof(VertexNormTex);
+
+	// quantized vertices are converted here, the cache keeps the float layout
+	std::vector<unsigned char> quantized;
+	const unsigned char* vertices = data.vertices;
+	int stride = data.vertexStride;
+	if (mQuantized)
+	{
+		quantizeVertices(data, quantized);
+		vertices = quantized.data();
+		stride = texCoords ? sizeof(VertexQuantizedNormTex) : sizeof(VertexQuantizedNormal);
+	}
+
+	// indices are relative to each submesh's base vertex, so 16 bits suffice whenever every submesh is small enough
+	GLuint maxIndex = 0;
+	for (int i = 0; i < data.numIndices; i++)
+		maxIndex = std::max(maxIndex, data.indices[i]);
+
+	std::vector<GLushort> shortIndices;
+	const void* indices = data.indices;
+	GLsizeiptr indexBytes = static_cast<GLsizeiptr>(sizeof(GLuint)) * data.numIndices;
+	mMesh.indexType = GL_UNSIGNED_INT;
+	if (mQuantized && maxIndex <= 0xFFFF)
+	{
+		shortIndices.assign(data.indices, data.indices + data.numIndices);
+		indices = shortIndices.data();
+		indexBytes = static_cast<GLsizeiptr>(sizeof(GLushort)) * data.numIndices;
+		mMesh.indexType = GL_UNSIGNED_SHORT;
+	}
 
-	// generate identifier for VBOs and copy data to GPU
+	// generate identifier for VBOs and copy data to GPU, mapped cache files are read straight from the page cache
 	glGenBuffers(1, &mMesh.VBO);
 	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexNormTex), &vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(stride) * data.numVertices, vertices, GL_STATIC_DRAW);
 
 	// generate identifier for IBO and copy data to GPU
 	glGenBuffers(1, &mMesh.IBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLint), &indices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
 
 	// generate identifiers for VAO and supply information
 	glGenVertexArrays(1, &mMesh.VAO);
 	glBindVertexArray(mMesh.VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, position)));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, normal)));
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, texCoord)));
+	if (mQuantized)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(VertexQuantizedNormTex, position)));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(VertexQuantizedNormTex, normal)));
+		if (texCoords)
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(VertexQuantizedNormTex, texCoord)));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(VertexNormal, position)));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(VertexNormal, normal)));
+		if (texCoords)
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(VertexNormTex, texCoord)));
+	}
 
 	// enable vertex attributes
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
+	if (texCoords)
+		glEnableVertexAttribArray(2);
 
 	// unbind VAO
 	glBindVertexArray(0);
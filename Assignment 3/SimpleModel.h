@@ -6,6 +6,7 @@
 #include <assimp/postprocess.h>     // post processing flags
 
 #include "utilities.h"
+#include "MeshCache.h"
 #include "ShaderProgram.h"
 
 struct Mesh
@@ -16,10 +17,28 @@ struct Mesh
     GLuint VAO = 0;
     int numOfIndices = 0;
     bool hasTexCoords = false;
+    GLenum indexType = GL_UNSIGNED_INT;    // GL_UNSIGNED_SHORT when every index fits in 16 bits
+
+    // decode ranges of quantized vertices
+    bool quantized = false;
+    GLfloat positionMin[3] = {};
+    GLfloat positionExtent[3] = {};
+    GLfloat texCoordMin[2] = {};
+    GLfloat texCoordExtent[2] = {};
+    std::vector<Submesh> submeshes;    // ranges of the shared buffers drawn one by one, grouped by level of detail
+    std::vector<float> lodErrors;      // simplification error of each level in model units
 };
 
 /*****************************************************************
- * simple model class that loads the first mesh of a model
+ * simple model class that loads every mesh of a model into one
+ * shared vertex and index buffer behind a single VAO, each mesh
+ * is drawn as a submesh with glDrawElementsBaseVertex
+ * imported meshes are optimized for the vertex cache, overdraw
+ * and vertex fetch, and get coarser levels of detail in the same
+ * index buffer, before they are cached. quantized models are
+ * uploaded in the 16-bit layouts and decoded by the vertex shader
+ * imported meshes are written to the mesh cache and mapped from
+ * it on later loads, skipping the import
  *****************************************************************/
 class SimpleModel
 {
@@ -27,15 +46,52 @@ public:
     SimpleModel();
     ~SimpleModel();
 
-    void loadModel(const char *filename, bool texture = false);
-    void drawModel();
+    // quantized models use VertexQuantizedNormal or VertexQuantizedNormTex on the GPU
+    void loadModel(const char *filename, bool texture = false, bool quantized = false);
+    // projectedSize is the bounding sphere radius in pixels and selects the level of detail, negative draws full detail
+    // view keeps a separate level per viewport so hysteresis works when a model is drawn in several
+    void drawModel(float projectedSize = -1.0f, int view = 0);
+
+    // bounding sphere radius in pixels for a model-view-projection matrix and viewport height
+    float projectedSize(const glm::mat4& modelViewProjection, float viewportHeight) const;
+
+    // triangles drawn since the last reset, and how many full detail would have drawn
+    static void resetCounts();
+    static int getTrianglesDrawn();
+    static int getFullDetailTriangles();
+
+    // a level is used while its error stays below this many pixels
+    static const float cLodPixelError;
+    // a coarser level is only chosen once its error falls below this fraction of the limit
+    static const float cLodHysteresis;
+    // views with separate levels, three viewports each for the direct and the reflected pass
+    static const int cMaxViews = 6;
+
+    // axis aligned bounds of the vertex positions
+    glm::vec3 getBoundsMin() const;
+    glm::vec3 getBoundsMax() const;
 
 private:
     bool mIsValid = false;
     Mesh mMesh;
+    bool mQuantized = false;
+    GLfloat mBoundsMin[3] = {};
+    GLfloat mBoundsMax[3] = {};
+    int mLods[cMaxViews] = {};    // current level of each view
+
+    static int sTrianglesDrawn;
+    static int sFullDetailTriangles;
  
-    void loadMesh(const aiMesh *mesh);
-    void loadMeshWithTexture(const aiMesh* mesh);
+    // append the vertices and triangle indices of an imported mesh, returns false if it has no positions, normals or faces
+    // indices are relative to the first appended vertex
+    bool loadMesh(const aiMesh *mesh, std::vector<VertexNormal>& vertices, std::vector<GLuint>& indices);
+    bool loadMeshWithTexture(const aiMesh* mesh, std::vector<VertexNormTex>& vertices, std::vector<GLuint>& indices);
+    // create the buffers and vertex array of a mesh
+    void upload(const MeshData& data);
+    // convert float vertices to the quantized layout and record the decode ranges
+    void quantizeVertices(const MeshData& data, std::vector<unsigned char>& vertices);
+    // level of detail for a projected size, with hysteresis per view
+    int selectLod(float projectedSize, int view);
 };
 
 #endif
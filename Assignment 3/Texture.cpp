@@ -1,8 +1,282 @@
 #include "Texture.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "MappedFile.h"
+#include "TextureUnits.h"
+#include "EnvironmentMap.h"
+#include "HeightMap.h"
+#include "Timing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <memory>
 
 #define STB_IMAGE_IMPLEMENTATION   
 #include "stb_image.h"
 
+namespace
+{
+	// texture cache variants
+	const uint32_t cVariantColor = 0;
+	const uint32_t cVariantNormal = 1;
+	const uint32_t cVariantEnvironment = 2;
+	const uint32_t cVariantPanorama = 3;
+	const uint32_t cVariantHeight = 4;
+
+	// image decoded by stb_image, freed automatically
+	struct DecodedImage
+	{
+		std::unique_ptr<unsigned char, void (*)(void*)> pixels{ nullptr, stbi_image_free };
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+	};
+
+	// decode the contents of an image file keeping its channel count
+	DecodedImage decodeImage(const std::vector<unsigned char>* fileData)
+	{
+		DecodedImage image;
+		image.pixels.reset(stbi_load_from_memory(fileData->data(), static_cast<int>(fileData->size()),
+			&image.width, &image.height, &image.channels, 0));
+		return image;
+	}
+
+	// pixel array of an uncompressed, bottom-up 24-bit bitmap
+	struct BitmapView
+	{
+		const unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int rowStride = 0;
+	};
+
+	uint32_t readU32(const unsigned char* p)
+	{
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	}
+
+	// locate the pixel array of a mapped BMP file
+	// only layouts that can be uploaded directly as GL_BGR are accepted
+	bool parseBitmap(const MappedFile& file, BitmapView& view)
+	{
+		const unsigned char* data = file.data();
+		size_t size = file.size();
+
+		// BITMAPFILEHEADER (14 bytes) followed by at least a BITMAPINFOHEADER (40 bytes)
+		if (size < 54 || data[0] != 'B' || data[1] != 'M')
+			return false;
+
+		uint32_t pixelOffset = readU32(data + 10);
+		int32_t width = static_cast<int32_t>(readU32(data + 18));
+		int32_t height = static_cast<int32_t>(readU32(data + 22));
+		int bitCount = data[28] | (data[29] << 8);
+		uint32_t compression = readU32(data + 30);
+
+		// 24-bit BI_RGB, bottom-up rows (negative height means top-down)
+		if (bitCount != 24 || compression != 0 || width <= 0 || height <= 0)
+			return false;
+
+		// rows are padded to 4 bytes, matching GL_UNPACK_ALIGNMENT 4
+		int rowStride = (width * 3 + 3) & ~3;
+		if (pixelOffset + static_cast<size_t>(rowStride) * height > size)
+			return false;
+
+		view.pixels = data + pixelOffset;
+		view.width = width;
+		view.height = height;
+		view.rowStride = rowStride;
+		return true;
+	}
+
+	// estimated bytes of one image of a mip level
+	// drivers pad three channel formats to four bytes per texel
+	size_t levelBytes(GLenum internalFormat, bool compressed, int width, int height)
+	{
+		if (compressed)
+		{
+			size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+			bool halfBlock = internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			return blocks * (halfBlock ? 8 : 16);
+		}
+
+		size_t texelSize = 4;
+		if (internalFormat == GL_R8 || internalFormat == GL_RED)
+			texelSize = 1;
+		else if (internalFormat == GL_RG8 || internalFormat == GL_RG)
+			texelSize = 2;
+
+		return static_cast<size_t>(width) * height * texelSize;
+	}
+
+	// sized internal format and pixel format for the source channel count of an image decoded to RGBA
+	// R8 for grayscale, RG8 for two channels and RGBA8 for everything else,
+	// three channel sources keep their padded RGBA pixels, drivers store RGB8 as RGBA8 anyway
+	void channelFormats(int channels, GLenum& internalFormat, GLenum& format)
+	{
+		switch (channels)
+		{
+		case 1:
+			internalFormat = GL_R8;
+			format = GL_RED;
+			break;
+		case 2:
+			internalFormat = GL_RG8;
+			format = GL_RG;
+			break;
+		default:
+			internalFormat = GL_RGBA8;
+			format = GL_RGBA;
+			break;
+		}
+	}
+
+	// pixel format with the same channels as an uncompressed internal format
+	GLenum storageFormat(GLenum internalFormat)
+	{
+		if (internalFormat == GL_R8)
+			return GL_RED;
+		if (internalFormat == GL_RG8)
+			return GL_RG;
+		return GL_RGBA;
+	}
+
+	// bytes per pixel of an unsigned byte pixel format
+	int pixelSize(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_RED:
+			return 1;
+		case GL_RG:
+			return 2;
+		case GL_RGB:
+		case GL_BGR:
+			return 3;
+		default:
+			return 4;
+		}
+	}
+
+	// unpack alignment for tightly packed rows, 4 whenever the rows allow it
+	GLint rowAlignment(GLenum format, int width)
+	{
+		return (pixelSize(format) * width) % 4 == 0 ? 4 : 1;
+	}
+
+	// whether texture array layers match in size, format and mip count
+	bool layersMatch(const std::vector<TextureData>& layers)
+	{
+		const TextureData& first = layers[0];
+		for (const TextureData& layer : layers)
+		{
+			if (layer.levels.size() != first.levels.size() || layer.internalFormat != first.internalFormat
+				|| layer.format != first.format || layer.compressed != first.compressed || layer.levels[0].width != first.levels[0].width
+				|| layer.levels[0].height != first.levels[0].height)
+			{
+				std::cout << "Texture array layers do not match in size or format" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// drop the finest levels skipped by the texture quality, keeping at least one
+	void skipFinestLevels(TextureData& data, int count)
+	{
+		count = std::min(count, static_cast<int>(data.levels.size()) - 1);
+		for (int i = 0; i < count; i++)
+			data.skippedBytes += levelBytes(data.internalFormat, data.compressed, data.levels[i].width, data.levels[i].height);
+
+		if (count > 0)
+			data.levels.erase(data.levels.begin(), data.levels.begin() + count);
+	}
+
+	// renormalise the averaged normals of every RGBA8 level and keep X and Y
+	// if packed the levels become RG8, otherwise X and Y stay in R and G of RGBA8 (e.g. for BC5)
+	void normaliseNormals(std::vector<TextureLevel>& levels, bool packed)
+	{
+		for (TextureLevel& level : levels)
+		{
+			size_t count = static_cast<size_t>(level.width) * level.height;
+			unsigned char* pixels = level.data.data();
+
+			for (size_t i = 0; i < count; i++)
+			{
+				float x = pixels[i * 4 + 0] / 127.5f - 1.0f;
+				float y = pixels[i * 4 + 1] / 127.5f - 1.0f;
+				float z = pixels[i * 4 + 2] / 127.5f - 1.0f;
+				float length = std::sqrt(x * x + y * y + z * z);
+				if (length > 0.0f)
+				{
+					x /= length;
+					y /= length;
+				}
+
+				unsigned char* out = pixels + i * (packed ? 2 : 4);
+				out[0] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, (x + 1.0f) * 127.5f + 0.5f)));
+				out[1] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, (y + 1.0f) * 127.5f + 0.5f)));
+			}
+			if (packed)
+				level.data.resize(count * 2);
+		}
+	}
+
+	// keep the first channels of every RGBA8 level
+	// two channel images keep luminance and alpha, which stb_image expands to RGB and A
+	void packChannels(std::vector<TextureLevel>& levels, int channels)
+	{
+		for (TextureLevel& level : levels)
+		{
+			size_t count = static_cast<size_t>(level.width) * level.height;
+			unsigned char* pixels = level.data.data();
+
+			for (size_t i = 0; i < count; i++)
+			{
+				pixels[i * channels] = pixels[i * 4];
+				if (channels == 2)
+					pixels[i * 2 + 1] = pixels[i * 4 + 3];
+			}
+			level.data.resize(count * channels);
+		}
+	}
+
+	// pixels to pass to the upload of a level, an offset into the bound pixel unpack buffer if it was staged
+	// levels held in a memory-mapped file are never staged, they are read straight from the mapping with
+	// the unpack buffer unbound, rebind receives the buffer to bind again afterwards (0 if none)
+	const void* unpackSource(const TextureLevel& level, const std::vector<GLintptr>* pboOffsets, size_t index,
+		GLint& rebind)
+	{
+		rebind = 0;
+		if (!pboOffsets)
+			return level.pixels();
+		if (!level.external)
+			return reinterpret_cast<const void*>((*pboOffsets)[index]);
+
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &rebind);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return level.external;
+	}
+
+	void rebindUnpackBuffer(GLint rebind)
+	{
+		if (rebind != 0)
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(rebind));
+	}
+}
+
+bool Texture::sCompressionEnabled = true;
+MipFilter Texture::sMipFilter = MipFilter::Box;
+float Texture::sHeightMapStrength = HeightMap::cDefaultStrength;
+Texture::Quality Texture::sQuality = Texture::Quality::Full;
+GLuint Texture::sPlaceholder2D = 0;
+GLuint Texture::sPlaceholderArray = 0;
+GLuint Texture::sError2D = 0;
+GLuint Texture::sErrorArray = 0;
+unsigned int Texture::sFrame = 0;
+
 Texture::Texture()
 {
 	stbi_set_flip_vertically_on_load(true); // flip image about y-axis
@@ -14,98 +288,103 @@ Texture::~Texture()
 	if (mTextureID != 0)
 	{
 		// delete texture
+		TextureUnits::forgetTexture(mTextureID);
 		glDeleteTextures(1, &mTextureID);
 		mTextureID = 0;
 	}
+	if (mMipQuery != 0)
+		glDeleteQueries(1, &mMipQuery);
 }
 
-void Texture::bind()
+void Texture::bind(int unit)
 {
+	mLastUsedFrame = sFrame;
+
+	if (mAlias)
+	{
+		mAlias->bind(unit);
+		return;
+	}
+
+	// bind placeholder while waiting for an asynchronous load, or while no level of a progressive load is resident
+	// and the error texture if that load failed
+	GLuint texture = mTextureID;
+	if ((mState == State::Pending || mState == State::Failed) && (texture == 0 || mResidentLevel >= mLevels))
+		texture = placeholder(mTarget, mState == State::Failed);
+
 	// if texture exists
-	if (mTextureID != 0)
+	if (texture != 0)
 	{
-		glBindTexture(mTarget, mTextureID);
+		// sampler objects are shared by textures with the same parameters
+		if (mSampler == 0)
+			mSampler = TextureUnits::getSampler(mMagFilter, mMinFilter, mWrapS, mWrapT, mWrapR);
+
+		TextureUnits::bindTexture(unit, mTarget, texture);
+		TextureUnits::bindSampler(unit, mSampler);
 	}
 }
 
 void Texture::setFilterParams(GLuint magFilter, GLuint minFilter)
 {
-	// parameter settings
-	GLuint mMagFilter = magFilter;
-	GLuint mMinFilter = minFilter;
-
-	// change filters if texture exists
-	if (mTextureID != 0)
-	{
-		glBindTexture(GL_TEXTURE_2D, mTextureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mMagFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mMinFilter);
-	}
+	// parameter settings, applied through the sampler on the next bind
+	mMagFilter = magFilter;
+	mMinFilter = minFilter;
+	mSampler = 0;
 }
 
 void Texture::setWrapParams(GLuint wrapS, GLuint wrapT)
 {
-	// parameter settings
-	GLuint mWrapS = wrapS;
-	GLuint mWrapT = wrapT;
-
-	// change wrap mode if texture exists
-	if (mTextureID != 0)
-	{
-		glBindTexture(GL_TEXTURE_2D, mTextureID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mWrapS);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mWrapT);
-	}
+	// parameter settings, applied through the sampler on the next bind
+	mWrapS = wrapS;
+	mWrapT = wrapT;
+	mSampler = 0;
 }
 
 // generate a 2D texture from image data
 void Texture::generate(unsigned char* imageData, int width, int height)
 {
+	resetLoadStats();
+	auto start = std::chrono::steady_clock::now();
+
 	// generate texture
 	glGenTextures(1, &mTextureID);
-	glBindTexture(GL_TEXTURE_2D, mTextureID);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mTextureID);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// RGB data is stored as RGBA8, which drivers use for RGB8 anyway
+	int numLevels = MipGenerator::levelCount(width, height);
+	if (GLEW_ARB_texture_storage)
+	{
+		glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_RGBA8, width, height);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, rowAlignment(GL_RGB, width));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, imageData);
+	}
+	else
+	{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, rowAlignment(GL_RGB, width));
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	mUploadMs = Timing::elapsedMs(start);
 
-	// set texture parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mMagFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mMinFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mWrapS);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mWrapT);
+	generateMipmap(GL_TEXTURE_2D);
+	setStorage(GL_RGBA8, false, width, height, numLevels, 1);
 
 	// set texture target
 	mTarget = GL_TEXTURE_2D;
+	mState = State::Ready;
 }
 
 // generate a 2D texture from an image file
 void Texture::generate(const std::string filename)
 {
 	// load image data
-	int width, height, channels;
-	unsigned char* imageData = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+	TextureData data;
 
 	// if successfully loaded image
-	if (imageData)
+	if (decode(filename, useCompression(), data, mType, 0, skippedLevels()))
 	{
-		// generate texture
-		glGenTextures(1, &mTextureID);
-		glBindTexture(GL_TEXTURE_2D, mTextureID);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// set texture parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mMagFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mMinFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, mWrapS);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, mWrapT);
-
-		// free image data
-		stbi_image_free(imageData);
-
-		// set texture target
-		mTarget = GL_TEXTURE_2D;
+		upload(data);
+		setSources({ filename });
 	}
 	else
 	{
@@ -117,50 +396,1217 @@ void Texture::generate(const std::string fileFront, const std::string fileBack,
 	const std::string fileLeft, const std::string fileRight,
 	const std::string fileTop, const std::string fileBottom)
 {
-	// load image data
-	// assume images are the same size
+	// face files in OpenGL face order: +X, -X, +Y, -Y, +Z, -Z
+	const std::string* faceFiles[6] = { &fileRight, &fileLeft, &fileTop, &fileBottom, &fileBack, &fileFront };
+	auto start = std::chrono::steady_clock::now();
+
+	// the face files are read once, the prefiltered chain is cached keyed by their contents
+	std::vector<unsigned char> fileData[6];
+	for (int i = 0; i < 6; i++)
+	{
+		if (!TextureCache::readFile(*faceFiles[i], fileData[i]))
+		{
+			std::cout << "Unable to load cubemap image: " << *faceFiles[i] << std::endl;
+			return;
+		}
+	}
+
+	uint32_t variant = cVariantEnvironment;
+	uint64_t hash = TextureCache::hash(&EnvironmentMap::cMaxPower, sizeof(EnvironmentMap::cMaxPower));
+	hash = TextureCache::hash(&EnvironmentMap::cMaxPrefilterSource, sizeof(EnvironmentMap::cMaxPrefilterSource), hash);
+	for (int i = 0; i < 6; i++)
+	{
+		uint64_t fileSize = fileData[i].size();
+		hash = TextureCache::hash(&fileSize, sizeof(fileSize), hash);
+		hash = TextureCache::hash(fileData[i].data(), fileData[i].size(), hash);
+	}
+	uint64_t key = TextureCache::makeKey(hash, variant);
+
+	// on a cache miss, decode all faces concurrently then convolve each level
+	// with a wider specular lobe for glossy reflections
+	TextureData data;
+	if (!TextureCache::load(key, data))
+	{
+		std::future<DecodedImage> futures[6];
+		for (int i = 0; i < 6; i++)
+		{
+			futures[i] = std::async(std::launch::async, decodeImage, &fileData[i]);
+		}
+
+		DecodedImage faces[6];
+		for (int i = 0; i < 6; i++)
+		{
+			faces[i] = futures[i].get();
+		}
+
+		// check every face loaded and matches the first face
+		// faces that did load are freed by DecodedImage either way
+		for (int i = 0; i < 6; i++)
+		{
+			if (!faces[i].pixels)
+			{
+				std::cout << "Unable to load cubemap image: " << *faceFiles[i] << std::endl;
+				return;
+			}
+			if (faces[i].width != faces[i].height)
+			{
+				std::cout << "Cubemap image is not square: " << *faceFiles[i] << std::endl;
+				return;
+			}
+			if (faces[i].width != faces[0].width || faces[i].channels != faces[0].channels)
+			{
+				std::cout << "Cubemap image size or format does not match " << *faceFiles[0]
+					<< ": " << *faceFiles[i] << std::endl;
+				return;
+			}
+		}
+
+		const unsigned char* pixels[6];
+		for (int i = 0; i < 6; i++)
+			pixels[i] = faces[i].pixels.get();
+
+		CubeImage cube;
+		EnvironmentMap::fromImages(pixels, faces[0].width, faces[0].channels, cube);
+
+		auto mipStart = std::chrono::steady_clock::now();
+		EnvironmentMap::prefilter(cube, data.levels);
+		data.mipMs = Timing::elapsedMs(mipStart);
+
+		data.internalFormat = GL_RGBA8;
+		data.format = GL_RGBA;
+		data.compressed = false;
+		TextureCache::store(key, data);
+	}
+	data.decodeMs = Timing::elapsedMs(start) - data.mipMs;
+
+	uploadCube(data);
+}
+
+// generate a cube environment map from an equirectangular panorama
+// the file is read once, on a cache miss it is resampled to faces and prefiltered
+void Texture::generatePanorama(const std::string filename)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<unsigned char> fileData;
+	if (!TextureCache::readFile(filename, fileData))
+	{
+		std::cout << "Unable to load panorama image: " << filename << std::endl;
+		return;
+	}
+
+	// the prefiltered chain is cached, keyed by the file contents, the sizes it is filtered at
+	// and whether it is compressed
+	bool compress = useCompression();
+	uint32_t variant = cVariantPanorama | (compress ? 1u << 8 : 0u);
+	uint64_t hash = TextureCache::hash(fileData.data(), fileData.size());
+	hash = TextureCache::hash(&EnvironmentMap::cMaxPower, sizeof(EnvironmentMap::cMaxPower), hash);
+	hash = TextureCache::hash(&EnvironmentMap::cMaxPanoramaFaceSize, sizeof(EnvironmentMap::cMaxPanoramaFaceSize), hash);
+	hash = TextureCache::hash(&EnvironmentMap::cMaxPrefilterSource, sizeof(EnvironmentMap::cMaxPrefilterSource), hash);
+	uint64_t key = TextureCache::makeKey(hash, variant);
+
+	TextureData data;
+	if (!TextureCache::load(key, data))
+	{
+		if (!decodePanorama(fileData, compress, data))
+		{
+			std::cout << "Unable to load panorama image: " << filename << std::endl;
+			return;
+		}
+		TextureCache::store(key, data);
+	}
+	data.decodeMs = Timing::elapsedMs(start) - data.mipMs;
+
+	uploadCube(data);
+}
+
+bool Texture::decodePanorama(const std::vector<unsigned char>& fileData, bool compress, TextureData& data)
+{
+	// the resampling expects the top row first, so this thread skips the flip set for 2D textures
+	// and restores it afterwards, the global flag is never changed so other threads are unaffected
+	DecodedImage image;
+	stbi_set_flip_vertically_on_load_thread(0);
+	image.pixels.reset(stbi_load_from_memory(fileData.data(), static_cast<int>(fileData.size()),
+		&image.width, &image.height, &image.channels, 4));
+	stbi_set_flip_vertically_on_load_thread(1);
+
+	if (!image.pixels)
+		return false;
+
+	CubeImage cube;
+	EnvironmentMap::fromPanorama(image.pixels.get(), image.width, image.height, 4,
+		EnvironmentMap::panoramaFaceSize(image.width), cube);
+
+	auto mipStart = std::chrono::steady_clock::now();
+	EnvironmentMap::prefilter(cube, data.levels);
+	data.mipMs = Timing::elapsedMs(mipStart);
+
+	data.internalFormat = GL_RGBA8;
+	data.format = GL_RGBA;
+	data.compressed = false;
+
+	// the faces are opaque, so every face of every level is encoded as BC1
+	if (compress)
+	{
+		data.internalFormat = TextureCompressor::glFormat(BlockFormat::BC1);
+		data.compressed = true;
+
+		std::vector<unsigned char> blocks;
+		for (TextureLevel& face : data.levels)
+		{
+			TextureCompressor::compress(BlockFormat::BC1, face.data.data(), face.width, face.height, blocks);
+			face.data.swap(blocks);
+		}
+	}
+	return true;
+}
+
+// upload a prefiltered cube map, levels are stored level by level with six faces each
+void Texture::uploadCube(const TextureData& data)
+{
+	int numLevels = static_cast<int>(data.levels.size()) / 6;
+	int size = data.levels[0].width;
+
+	resetLoadStats();
+	recordDecode(data);
+	auto start = std::chrono::steady_clock::now();
+
+	// generate texture
+	glGenTextures(1, &mTextureID);
+	TextureUnits::bindForEdit(GL_TEXTURE_CUBE_MAP, mTextureID);
+
+	// allocate immutable storage for all faces when available
+	bool immutable = GLEW_ARB_texture_storage != GL_FALSE;
+	if (immutable)
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, numLevels, data.internalFormat, size, size);
+
+	for (int level = 0; level < numLevels; level++)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			GLenum faceTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+			const TextureLevel& face = data.levels[level * 6 + i];
+
+			if (data.compressed)
+			{
+				GLsizei faceSize = static_cast<GLsizei>(face.size());
+				if (immutable)
+					glCompressedTexSubImage2D(faceTarget, level, 0, 0, face.width, face.height, data.internalFormat, faceSize, face.pixels());
+				else
+					glCompressedTexImage2D(faceTarget, level, data.internalFormat, face.width, face.height, 0, faceSize, face.pixels());
+			}
+			else if (immutable)
+				glTexSubImage2D(faceTarget, level, 0, 0, face.width, face.height, data.format, GL_UNSIGNED_BYTE, face.pixels());
+			else
+				glTexImage2D(faceTarget, level, data.internalFormat, face.width, face.height, 0, data.format, GL_UNSIGNED_BYTE, face.pixels());
+		}
+	}
+	setStorage(data.internalFormat, data.compressed, size, size, numLevels, 6);
+	mUploadMs = Timing::elapsedMs(start);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+	// set sampler parameters, levels are sampled by roughness and faces must not wrap
+	mMagFilter = GL_LINEAR;
+	mMinFilter = GL_LINEAR_MIPMAP_LINEAR;
+	mWrapS = GL_CLAMP_TO_EDGE;
+	mWrapT = GL_CLAMP_TO_EDGE;
+	mWrapR = GL_CLAMP_TO_EDGE;
+	mSampler = 0;
+
+	// set texture target
+	mTarget = GL_TEXTURE_CUBE_MAP;
+	mState = State::Ready;
+}
+
+// generate a 2D texture array from image files, decoding layers concurrently
+void Texture::generateArray(const std::vector<std::string>& filenames)
+{
+	bool compress = useCompression();
+
+	std::vector<std::future<bool>> futures;
+	std::vector<TextureData> layers(filenames.size());
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		futures.push_back(std::async(std::launch::async, decode, filenames[i], compress, std::ref(layers[i]), mType, 0,
+			skippedLevels()));
+	}
+
+	bool success = true;
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		if (!futures[i].get())
+		{
+			std::cout << "Unable to load: " << filenames[i] << std::endl;
+			success = false;
+		}
+	}
+
+	if (success && uploadArray(layers))
+		setSources(filenames);
+}
+
+void Texture::setCompressionEnabled(bool enabled)
+{
+	sCompressionEnabled = enabled;
+}
+
+void Texture::setMipFilter(MipFilter filter)
+{
+	sMipFilter = filter;
+}
+
+void Texture::setQuality(Quality quality)
+{
+	sQuality = quality;
+}
+
+Texture::Quality Texture::getQuality()
+{
+	return sQuality;
+}
+
+int Texture::skippedLevels()
+{
+	return static_cast<int>(sQuality);
+}
+
+void Texture::setHeightMapStrength(float strength)
+{
+	sHeightMapStrength = strength;
+}
+
+bool Texture::useCompression()
+{
+	// BC1 and BC3 both need S3TC support
+	return sCompressionEnabled && TextureCompressor::isSupported(BlockFormat::BC1);
+}
+
+// decode an image file into texture data, timing decoding and mip generation separately
+// only touches CPU memory so it can run on a worker thread
+bool Texture::decode(const std::string& filename, bool compress, TextureData& data, Type type, int maxSize,
+	int skipLevels)
+{
+	auto start = std::chrono::steady_clock::now();
+	data.mipMs = 0.0;
+	data.skippedBytes = 0;
+
+	bool success = decodeFile(filename, compress, data, type, maxSize, skipLevels);
+	data.decodeMs = Timing::elapsedMs(start) - data.mipMs;
+	return success;
+}
+
+bool Texture::decodeFile(const std::string& filename, bool compress, TextureData& data, Type type, int maxSize,
+	int skipLevels)
+{
+	if (type == Type::NormalMap || type == Type::HeightMap)
+		return decodeNormalMap(filename, compress, data, type, maxSize, skipLevels);
+
+	if (compress)
+		return decodeCompressed(filename, data, maxSize, skipLevels);
+
+	// bitmaps are mapped and uploaded without decoding
+	if (decodeBitmap(filename, data))
+	{
+		skipFinestLevels(data, skipLevels);
+		return true;
+	}
+
+	// load image data, channels is the channel count of the source
 	int width, height, channels;
-	unsigned char* imageFront = stbi_load(fileFront.c_str(), &width, &height, &channels, 0);
-	unsigned char* imageBack = stbi_load(fileBack.c_str(), &width, &height, &channels, 0);
-	unsigned char* imageLeft = stbi_load(fileLeft.c_str(), &width, &height, &channels, 0);
-	unsigned char* imageRight = stbi_load(fileRight.c_str(), &width, &height, &channels, 0);
-	unsigned char* imageTop = stbi_load(fileTop.c_str(), &width, &height, &channels, 0);
-	unsigned char* imageBottom = stbi_load(fileBottom.c_str(), &width, &height, &channels, 0);
+	unsigned char* imageData = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+
+	if (!imageData)
+		return false;
+
+	// build the mip chain on the CPU, averaging colours in linear light
+	// one and two channel images hold data such as heights, which is averaged as is
+	channelFormats(channels, data.internalFormat, data.format);
+	data.compressed = false;
+	auto mipStart = std::chrono::steady_clock::now();
+	MipGenerator::generate(imageData, width, height, sMipFilter, channels >= 3, data.levels);
+	data.mipMs += Timing::elapsedMs(mipStart);
+
+	// free image data
+	stbi_image_free(imageData);
+
+	// only keep the channels the internal format stores
+	if (channels < 3)
+		packChannels(data.levels, channels);
+
+	skipFinestLevels(data, skipLevels);
+	return true;
+}
+
+bool Texture::isPartial(const TextureData& data)
+{
+	return !data.levels.empty() && data.levels[0].size() == 0;
+}
+
+// load an image file through the compressed texture cache
+// on a cache miss the image is decoded, mipmapped, compressed and stored
+bool Texture::decodeCompressed(const std::string& filename, TextureData& data, int maxSize, int skipLevels)
+{
+	// the cache is keyed by the source file contents
+	std::vector<unsigned char> fileData;
+	if (!TextureCache::readFile(filename, fileData))
+		return false;
+
+	// the mip filter changes the cooked result
+	uint32_t variant = cVariantColor | (static_cast<uint32_t>(sMipFilter) << 8);
+	uint64_t key = TextureCache::makeKey(TextureCache::hash(fileData.data(), fileData.size()), variant);
+
+	if (!TextureCache::load(key, data, maxSize, skipLevels))
+	{
+		// decode image data as RGBA
+		int width, height, channels;
+		unsigned char* imageData = stbi_load_from_memory(fileData.data(), static_cast<int>(fileData.size()),
+			&width, &height, &channels, 4);
+
+		if (!imageData)
+			return false;
+
+		// build the mip chain on the CPU
+		std::vector<TextureLevel> mips;
+		auto mipStart = std::chrono::steady_clock::now();
+		MipGenerator::generate(imageData, width, height, sMipFilter, true, mips);
+		data.mipMs += Timing::elapsedMs(mipStart);
+		stbi_image_free(imageData);
+
+		// compress every level, keeping alpha only if the source has it
+		BlockFormat blockFormat = (channels == 4) ? BlockFormat::BC3 : BlockFormat::BC1;
+		data.internalFormat = TextureCompressor::glFormat(blockFormat);
+		data.format = GL_RGBA;
+		data.compressed = true;
+		data.levels.resize(mips.size());
+
+		for (size_t i = 0; i < mips.size(); i++)
+		{
+			data.levels[i].width = mips[i].width;
+			data.levels[i].height = mips[i].height;
+			TextureCompressor::compress(blockFormat, mips[i].data.data(), mips[i].width, mips[i].height,
+				data.levels[i].data);
+		}
+
+		// the cache keeps every level so any quality can be read from it
+		TextureCache::store(key, data);
+		skipFinestLevels(data, skipLevels);
+	}
+
+	return true;
+}
+
+// load a normal map, keeping only X and Y, Z is rebuilt in the shader
+// height maps are converted to normals first, so only a third of the bytes are shipped and read
+// levels are averaged as vectors and renormalised, compressed maps are cooked to BC5 through the cache
+bool Texture::decodeNormalMap(const std::string& filename, bool compress, TextureData& data, Type type, int maxSize,
+	int skipLevels)
+{
+	std::vector<unsigned char> fileData;
+	if (!TextureCache::readFile(filename, fileData))
+		return false;
+
+	// the strength of derived normals changes the cooked result
+	bool derived = type == Type::HeightMap;
+	uint32_t variant = (derived ? cVariantHeight : cVariantNormal) | (static_cast<uint32_t>(sMipFilter) << 8);
+	uint64_t sourceHash = TextureCache::hash(fileData.data(), fileData.size());
+	if (derived)
+		sourceHash = TextureCache::hash(&sHeightMapStrength, sizeof(sHeightMapStrength), sourceHash);
+
+	uint64_t key = TextureCache::makeKey(sourceHash, variant);
+	if (compress && TextureCache::load(key, data, maxSize, skipLevels))
+		return true;
+
+	// decode image data as RGBA, or heights as one channel
+	int width, height, channels;
+	unsigned char* imageData = stbi_load_from_memory(fileData.data(), static_cast<int>(fileData.size()),
+		&width, &height, &channels, derived ? 1 : 4);
+
+	if (!imageData)
+		return false;
+
+	// derive normals from the heights
+	std::vector<unsigned char> normals;
+	const unsigned char* pixels = imageData;
+	if (derived)
+	{
+		HeightMap::toNormalMap(imageData, width, height, sHeightMapStrength, normals);
+		pixels = normals.data();
+	}
+
+	// build the mip chain without the sRGB curve, normals are not colours
+	std::vector<TextureLevel> mips;
+	auto mipStart = std::chrono::steady_clock::now();
+	MipGenerator::generate(pixels, width, height, sMipFilter, false, mips);
+	data.mipMs += Timing::elapsedMs(mipStart);
+	stbi_image_free(imageData);
+	normaliseNormals(mips, !compress);
+
+	if (!compress)
+	{
+		data.internalFormat = GL_RG8;
+		data.format = GL_RG;
+		data.compressed = false;
+		data.levels = std::move(mips);
+		skipFinestLevels(data, skipLevels);
+		return true;
+	}
+
+	// compress every level
+	data.internalFormat = TextureCompressor::glFormat(BlockFormat::BC5);
+	data.format = GL_RG;
+	data.compressed = true;
+	data.levels.resize(mips.size());
+
+	for (size_t i = 0; i < mips.size(); i++)
+	{
+		data.levels[i].width = mips[i].width;
+		data.levels[i].height = mips[i].height;
+		TextureCompressor::compress(BlockFormat::BC5, mips[i].data.data(), mips[i].width, mips[i].height,
+			data.levels[i].data);
+	}
+
+	TextureCache::store(key, data);
+	skipFinestLevels(data, skipLevels);
+	return true;
+}
+
+// map an uncompressed bitmap file so its pixel array is uploaded without decoding
+// rows are already bottom-up and BGR, so no flip or swizzle is needed
+// the mips are filtered from the mapped rows and the base level is uploaded from the mapping, never copied
+bool Texture::decodeBitmap(const std::string& filename, TextureData& data)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	BitmapView view;
+
+	if (!file->open(filename) || !parseBitmap(*file, view))
+		return false;
+
+	// levels 1 and up are filtered from the mapped pixels a few rows at a time
+	data.internalFormat = GL_RGBA8;
+	data.format = GL_RGBA;
+	data.compressed = false;
+	auto mipStart = std::chrono::steady_clock::now();
+	MipGenerator::generateBGR(view.pixels, view.width, view.height, view.rowStride, sMipFilter, true, data.levels);
+	data.mipMs += Timing::elapsedMs(mipStart);
+
+	// level 0 refers straight into the mapping
+	data.levels[0].external = view.pixels;
+	data.levels[0].externalSize = static_cast<size_t>(view.rowStride) * view.height;
+	data.levels[0].externalFormat = GL_BGR;
+	data.mapping = file;
 
-	// if successfully loaded cubemap images
-	if (imageFront && imageBack && imageLeft && imageRight && imageTop && imageBottom)
+	return true;
+}
+
+// create a 2D texture from prepared texture data
+void Texture::upload(const TextureData& data, const std::vector<GLintptr>* pboOffsets)
+{
+	int width = data.levels[0].width;
+	int height = data.levels[0].height;
+	int numLevels = static_cast<int>(data.levels.size());
+
+	// the rest of the mip chain is generated if only the base level was supplied
+	bool generateMips = numLevels == 1 && !data.compressed;
+	int storageLevels = generateMips ? MipGenerator::levelCount(width, height) : numLevels;
+
+	resetLoadStats();
+	recordDecode(data);
+	mSkippedBytes = data.skippedBytes;
+	mGeneration++;
+	mAlias.reset();
+	auto start = std::chrono::steady_clock::now();
+
+	// immutable storage cannot be reallocated, so a reloaded texture gets a new name
+	bool immutable = GLEW_ARB_texture_storage != GL_FALSE;
+	if (immutable && mTextureID != 0)
 	{
-		// generate texture
+		TextureUnits::forgetTexture(mTextureID);
+		glDeleteTextures(1, &mTextureID);
+		mTextureID = 0;
+	}
+
+	// generate texture
+	if (mTextureID == 0)
 		glGenTextures(1, &mTextureID);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, mTextureID);
-
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageRight);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageLeft);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageTop);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageBottom);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageBack);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageFront);
-
-		// set texture parameters
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-		// free image data
-		stbi_image_free(imageFront);
-		stbi_image_free(imageBack);
-		stbi_image_free(imageLeft);
-		stbi_image_free(imageRight);
-		stbi_image_free(imageTop);
-		stbi_image_free(imageBottom);
-
-		// set texture target
-		mTarget = GL_TEXTURE_CUBE_MAP;
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mTextureID);
+
+	// allocate every level at once
+	if (immutable)
+		glTexStorage2D(GL_TEXTURE_2D, storageLevels, data.internalFormat, width, height);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	// upload every level of the mip chain
+	for (size_t i = 0; i < data.levels.size(); i++)
+	{
+		const TextureLevel& level = data.levels[i];
+		GLint rebind;
+		const void* pixels = unpackSource(level, pboOffsets, i, rebind);
+		GLint index = static_cast<GLint>(i);
+
+		if (data.compressed)
+		{
+			GLsizei size = static_cast<GLsizei>(level.size());
+			if (immutable)
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, index, 0, 0, level.width, level.height, data.internalFormat, size, pixels);
+			else
+				glCompressedTexImage2D(GL_TEXTURE_2D, index, data.internalFormat, level.width, level.height, 0, size, pixels);
+		}
+		else
+		{
+			// padded bitmap rows are always 4-byte aligned
+			GLenum format = level.external ? level.externalFormat : data.format;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, level.external ? 4 : rowAlignment(format, level.width));
+
+			if (immutable)
+				glTexSubImage2D(GL_TEXTURE_2D, index, 0, 0, level.width, level.height, format, GL_UNSIGNED_BYTE, pixels);
+			else
+				glTexImage2D(GL_TEXTURE_2D, index, data.internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		}
+		rebindUnpackBuffer(rebind);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	mUploadMs = Timing::elapsedMs(start);
+
+	if (generateMips)
+		generateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, storageLevels - 1);
+	setStorage(data.internalFormat, data.compressed, width, height, storageLevels, 1);
+
+	// set texture target
+	mTarget = GL_TEXTURE_2D;
+	setReady();
+}
+
+// create a 2D texture array from prepared texture data
+bool Texture::uploadArray(const std::vector<TextureData>& layers, const std::vector<GLintptr>* pboOffsets)
+{
+	if (layers.empty())
+		return false;
+
+	// every layer must match the first in size, format and mip count
+	if (!layersMatch(layers))
+		return false;
+
+	const TextureData& first = layers[0];
+
+	GLsizei numLayers = static_cast<GLsizei>(layers.size());
+	GLsizei numLevels = static_cast<GLsizei>(first.levels.size());
+
+	resetLoadStats();
+	for (const TextureData& layer : layers)
+	{
+		recordDecode(layer);
+		mSkippedBytes += layer.skippedBytes;
+	}
+	mGeneration++;
+	mAlias.reset();
+	auto start = std::chrono::steady_clock::now();
+
+	// immutable storage cannot be reallocated, so a reloaded texture gets a new name
+	bool immutable = GLEW_ARB_texture_storage != GL_FALSE;
+	if (immutable && mTextureID != 0)
+	{
+		TextureUnits::forgetTexture(mTextureID);
+		glDeleteTextures(1, &mTextureID);
+		mTextureID = 0;
+	}
+
+	// generate texture
+	if (mTextureID == 0)
+		glGenTextures(1, &mTextureID);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D_ARRAY, mTextureID);
+
+	if (immutable)
+	{
+		// allocate every level and layer at once
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, first.internalFormat, first.levels[0].width,
+			first.levels[0].height, numLayers);
+	}
+	else
+	{
+		// allocate every level without a pixel unpack buffer bound
+		GLint pbo = 0;
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		for (GLsizei level = 0; level < numLevels; level++)
+		{
+			const TextureLevel& size = first.levels[level];
+
+			if (first.compressed)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.internalFormat, size.width, size.height,
+					numLayers, 0, static_cast<GLsizei>(size.size()) * numLayers, nullptr);
+			}
+			else
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.internalFormat, size.width, size.height,
+					numLayers, 0, first.format, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	}
+
+	// fill each layer
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	for (GLsizei layer = 0; layer < numLayers; layer++)
+	{
+		for (GLsizei level = 0; level < numLevels; level++)
+		{
+			const TextureLevel& source = layers[layer].levels[level];
+			GLint rebind;
+			const void* pixels = unpackSource(source, pboOffsets, layer * numLevels + level, rebind);
+
+			if (first.compressed)
+			{
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, source.width, source.height, 1,
+					first.internalFormat, static_cast<GLsizei>(source.size()), pixels);
+			}
+			else
+			{
+				// padded bitmap rows are always 4-byte aligned
+				GLenum format = source.external ? source.externalFormat : layers[layer].format;
+				glPixelStorei(GL_UNPACK_ALIGNMENT, source.external ? 4 : rowAlignment(format, source.width));
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, source.width, source.height, 1,
+					format, GL_UNSIGNED_BYTE, pixels);
+			}
+			rebindUnpackBuffer(rebind);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	mUploadMs = Timing::elapsedMs(start);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	setStorage(first.internalFormat, first.compressed, first.levels[0].width, first.levels[0].height, numLevels, numLayers);
+
+	// set texture target
+	mTarget = GL_TEXTURE_2D_ARRAY;
+	setReady();
+
+	return true;
+}
+
+bool Texture::replace(const std::vector<TextureData>& layers, const std::vector<GLintptr>* pboOffsets)
+{
+	if (mState != State::Ready || mEvicted || mResidentLevel != 0 || mTextureID == 0)
+		return false;
+
+	if (layers.empty() || static_cast<int>(layers.size()) != mLayers || !layersMatch(layers))
+		return false;
+
+	if (mTarget != GL_TEXTURE_2D && mTarget != GL_TEXTURE_2D_ARRAY)
+		return false;
+
+	// same storage, with either the whole chain or a base level whose mips are generated again
+	const TextureData& first = layers[0];
+	int numLevels = static_cast<int>(first.levels.size());
+	bool generateMips = numLevels == 1 && !first.compressed && mLevels > 1;
+
+	if (first.internalFormat != mInternalFormat || first.compressed != mCompressed
+		|| first.levels[0].width != mWidth || first.levels[0].height != mHeight
+		|| (numLevels != mLevels && !generateMips))
+		return false;
+
+	resetLoadStats();
+	for (const TextureData& layer : layers)
+	{
+		recordDecode(layer);
+		mSkippedBytes += layer.skippedBytes;
+	}
+	mGeneration++;
+
+	// overwrite each level of every layer
+	std::vector<GLintptr> levelOffsets(layers.size());
+	for (int level = 0; level < numLevels; level++)
+	{
+		for (size_t layer = 0; layer < layers.size() && pboOffsets; layer++)
+			levelOffsets[layer] = (*pboOffsets)[layer * numLevels + level];
+
+		uploadLevel(layers, level, pboOffsets ? &levelOffsets : nullptr);
+	}
+
+	if (generateMips)
+		generateMipmap(mTarget);
+
+	return true;
+}
+
+bool Texture::allocate(const std::vector<TextureData>& layers, bool array)
+{
+	if (layers.empty() || !layersMatch(layers))
+		return false;
+
+	const TextureData& first = layers[0];
+	GLenum target = array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	GLsizei numLayers = static_cast<GLsizei>(layers.size());
+	GLsizei numLevels = static_cast<GLsizei>(first.levels.size());
+	int width = first.levels[0].width;
+	int height = first.levels[0].height;
+
+	resetLoadStats();
+	for (const TextureData& layer : layers)
+	{
+		recordDecode(layer);
+		mSkippedBytes += layer.skippedBytes;
+	}
+	mAlias.reset();
+	auto start = std::chrono::steady_clock::now();
+
+	// immutable storage cannot be reallocated, so every load gets a new name
+	if (mTextureID != 0)
+	{
+		TextureUnits::forgetTexture(mTextureID);
+		glDeleteTextures(1, &mTextureID);
+		mTextureID = 0;
+	}
+
+	glGenTextures(1, &mTextureID);
+	TextureUnits::bindForEdit(target, mTextureID);
+
+	if (GLEW_ARB_texture_storage)
+	{
+		if (array)
+			glTexStorage3D(target, numLevels, first.internalFormat, width, height, numLayers);
+		else
+			glTexStorage2D(target, numLevels, first.internalFormat, width, height);
+	}
+	else
+	{
+		// define every level without a pixel unpack buffer bound
+		GLint pbo = 0;
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		for (GLsizei level = 0; level < numLevels; level++)
+		{
+			const TextureLevel& size = first.levels[level];
+			GLsizei bytes = static_cast<GLsizei>(levelBytes(first.internalFormat, first.compressed, size.width, size.height));
+
+			if (first.compressed && array)
+				glCompressedTexImage3D(target, level, first.internalFormat, size.width, size.height, numLayers, 0, bytes * numLayers, nullptr);
+			else if (first.compressed)
+				glCompressedTexImage2D(target, level, first.internalFormat, size.width, size.height, 0, bytes, nullptr);
+			else if (array)
+				glTexImage3D(target, level, first.internalFormat, size.width, size.height, numLayers, 0, first.format, GL_UNSIGNED_BYTE, nullptr);
+			else
+				glTexImage2D(target, level, first.internalFormat, size.width, size.height, 0, first.format, GL_UNSIGNED_BYTE, nullptr);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	}
+
+	// nothing is resident yet, the base level is lowered as levels arrive
+	// GL_TEXTURE_MIN_LOD would be overridden by the shared sampler objects, so the base level is the clamp
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, numLevels - 1);
+	setStorage(first.internalFormat, first.compressed, width, height, numLevels, numLayers);
+	mResidentLevel = numLevels;
+	mUploadMs = Timing::elapsedMs(start);
+
+	mTarget = target;
+	return true;
+}
+
+void Texture::uploadLevel(const std::vector<TextureData>& layers, int level, const std::vector<GLintptr>* pboOffsets)
+{
+	auto start = std::chrono::steady_clock::now();
+	TextureUnits::bindForEdit(mTarget, mTextureID);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	for (size_t layer = 0; layer < layers.size(); layer++)
+	{
+		const TextureLevel& source = layers[layer].levels[level];
+		GLint rebind;
+		const void* pixels = unpackSource(source, pboOffsets, layer, rebind);
+		GLint index = static_cast<GLint>(layer);
+
+		if (mCompressed)
+		{
+			GLsizei size = static_cast<GLsizei>(source.size());
+			if (mTarget == GL_TEXTURE_2D_ARRAY)
+				glCompressedTexSubImage3D(mTarget, level, 0, 0, index, source.width, source.height, 1, mInternalFormat, size, pixels);
+			else
+				glCompressedTexSubImage2D(mTarget, level, 0, 0, source.width, source.height, mInternalFormat, size, pixels);
+		}
+		else
+		{
+			// padded bitmap rows are always 4-byte aligned
+			GLenum format = source.external ? source.externalFormat : layers[layer].format;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, source.external ? 4 : rowAlignment(format, source.width));
+
+			if (mTarget == GL_TEXTURE_2D_ARRAY)
+				glTexSubImage3D(mTarget, level, 0, 0, index, source.width, source.height, 1, format, GL_UNSIGNED_BYTE, pixels);
+			else
+				glTexSubImage2D(mTarget, level, 0, 0, source.width, source.height, format, GL_UNSIGNED_BYTE, pixels);
+		}
+		rebindUnpackBuffer(rebind);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// sample down to the new level
+	if (level < mResidentLevel)
+	{
+		mResidentLevel = level;
+		glTexParameteri(mTarget, GL_TEXTURE_BASE_LEVEL, level);
+	}
+	mUploadMs += Timing::elapsedMs(start);
+
+	setReady();
+}
+
+int Texture::getResidentLevel() const
+{
+	return mResidentLevel;
+}
+
+void Texture::recordDecode(const TextureData& data)
+{
+	mDecodeMs += data.decodeMs;
+	mMipMs += data.mipMs;
+}
+
+void Texture::resetLoadStats()
+{
+	mDecodeMs = 0.0;
+	mMipMs = 0.0;
+	mUploadMs = 0.0;
+	mSkippedBytes = 0;
+	mMipQueryPending = false;
+}
+
+void Texture::generateMipmap(GLenum target)
+{
+	// glGenerateMipmap only queues the work, so the CPU time around it says little
+	if (mMipQuery == 0)
+		glGenQueries(1, &mMipQuery);
+	readMipQuery(true);
+
+	glBeginQuery(GL_TIME_ELAPSED, mMipQuery);
+	glGenerateMipmap(target);
+	glEndQuery(GL_TIME_ELAPSED);
+	mMipQueryPending = true;
+}
+
+void Texture::readMipQuery(bool wait) const
+{
+	if (!mMipQueryPending)
+		return;
+
+	if (!wait)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(mMipQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;
+	}
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(mMipQuery, GL_QUERY_RESULT, &nanoseconds);
+	mMipMs += nanoseconds / 1.0e6;
+	mMipQueryPending = false;
+}
+
+TextureStats Texture::getStats() const
+{
+	readMipQuery(false);
+
+	TextureStats stats;
+	if (mTextureID == 0)
+		return stats;
+
+	stats.target = mTarget;
+	stats.internalFormat = mInternalFormat;
+	stats.compressed = mCompressed;
+	stats.width = mWidth;
+	stats.height = mHeight;
+	stats.levels = mLevels;
+	stats.layers = mLayers;
+	stats.bytes = mSizeBytes;
+	stats.skippedBytes = mSkippedBytes;
+	stats.decodeMs = mDecodeMs;
+	stats.mipMs = mMipMs;
+	stats.uploadMs = mUploadMs;
+	return stats;
+}
+
+void Texture::setPending(GLenum target, std::function<void(Texture&)> callback)
+{
+	mTarget = target;
+	mState = State::Pending;
+	mReadyCallback = callback;
+	mGeneration++;
+}
+
+void Texture::alias(const std::shared_ptr<Texture>& source)
+{
+	mAlias = source;
+	mTarget = source->getTarget();
+	setReady();
+}
+
+bool Texture::isAlias() const
+{
+	return mAlias != nullptr;
+}
+
+void Texture::setFailed()
+{
+	// the ready callback is dropped, a later load sets its own
+	if (mState != State::Pending)
+		return;
+
+	mState = State::Failed;
+	mReadyCallback = nullptr;
+}
+
+unsigned int Texture::getGeneration() const
+{
+	return mGeneration;
+}
+
+void Texture::setReady()
+{
+	State previousState = mState;
+	mState = State::Ready;
+
+	// notify anyone waiting on an asynchronous load
+	if (previousState == State::Pending && mReadyCallback)
+	{
+		mReadyCallback(*this);
+		mReadyCallback = nullptr;
+	}
+}
+
+GLuint Texture::placeholder(GLenum target, bool failed)
+{
+	// grey while loading, magenta once a load failed so missing files stand out
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	const unsigned char magenta[4] = { 255, 0, 255, 255 };
+	const unsigned char* colour = failed ? magenta : grey;
+
+	// create the shared placeholders on first use
+	if (target == GL_TEXTURE_2D_ARRAY)
+	{
+		GLuint& texture = failed ? sErrorArray : sPlaceholderArray;
+		if (texture == 0)
+		{
+			glGenTextures(1, &texture);
+			TextureUnits::bindForEdit(GL_TEXTURE_2D_ARRAY, texture);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, colour);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);	// complete with mipmapped samplers
+		}
+		return texture;
+	}
+
+	GLuint& texture = failed ? sError2D : sPlaceholder2D;
+	if (texture == 0)
+	{
+		glGenTextures(1, &texture);
+		TextureUnits::bindForEdit(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, colour);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);	// complete with mipmapped samplers
+	}
+	return texture;
+}
+
+void Texture::nextFrame()
+{
+	sFrame++;
+}
+
+unsigned int Texture::getFrame()
+{
+	return sFrame;
+}
+
+void Texture::setStorage(GLenum internalFormat, bool compressed, int width, int height, int levels, int layers)
+{
+	mInternalFormat = internalFormat;
+	mCompressed = compressed;
+	mWidth = width;
+	mHeight = height;
+	mLevels = levels;
+	mLayers = layers;
+	mResidentLevel = 0;
+	mEvicted = false;
+
+	// sum every level of every layer
+	mSizeBytes = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		mSizeBytes += levelBytes(internalFormat, compressed, std::max(1, width >> level), std::max(1, height >> level)) * layers;
+	}
+}
+
+size_t Texture::getSizeBytes() const
+{
+	return mTextureID != 0 ? mSizeBytes : 0;
+}
+
+unsigned int Texture::getLastUsedFrame() const
+{
+	return mLastUsedFrame;
+}
+
+const std::vector<std::string>& Texture::getSources() const
+{
+	return mSources;
+}
+
+void Texture::setSources(const std::vector<std::string>& sources)
+{
+	mSources = sources;
+}
+
+void Texture::setType(Type type)
+{
+	mType = type;
+}
+
+Texture::Type Texture::getType() const
+{
+	return mType;
+}
+
+int Texture::getLevelCount() const
+{
+	return mLevels;
+}
+
+bool Texture::read(int level, std::vector<unsigned char>& pixels, int& width, int& height) const
+{
+	if (mTextureID == 0 || mState != State::Ready || level < 0 || level >= mLevels)
+		return false;
+
+	width = std::max(1, mWidth >> level);
+	height = std::max(1, mHeight >> level);
+	size_t layerSize = static_cast<size_t>(width) * height * 4;
+	pixels.resize(layerSize * mLayers);
+
+	TextureUnits::bindForEdit(mTarget, mTextureID);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// cube faces are separate images, every layer of an array is returned at once
+	if (mTarget == GL_TEXTURE_CUBE_MAP)
+	{
+		for (int face = 0; face < 6; face++)
+		{
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA, GL_UNSIGNED_BYTE,
+				pixels.data() + layerSize * face);
+		}
 	}
 	else
 	{
-		std::cout << "Unable to load cubemap images starting with: " << fileFront << std::endl;
+		glGetTexImage(mTarget, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
 	}
+
+	return true;
+}
+
+GLenum Texture::getTarget() const
+{
+	return mTarget;
+}
+
+bool Texture::isEvicted() const
+{
+	return mEvicted;
+}
+
+// read back the low resolution tail of the mip chain and recreate the texture from it
+// the read back stalls the pipeline, so eviction is kept to textures that were not used this frame
+bool Texture::evict(int maxSize)
+{
+	if (mTextureID == 0 || mState != State::Ready || (mTarget != GL_TEXTURE_2D && mTarget != GL_TEXTURE_2D_ARRAY))
+		return false;
+
+	// textures still streaming in are already reduced
+	if (mResidentLevel > 0)
+		return false;
+
+	// first level that fits within maxSize
+	int firstLevel = 0;
+	while (firstLevel < mLevels - 1 && std::max(mWidth >> firstLevel, mHeight >> firstLevel) > maxSize)
+		firstLevel++;
+
+	if (firstLevel == 0)
+		return false;
+
+	// read back in the channels the texture stores
+	GLenum format = storageFormat(mInternalFormat);
+	std::vector<TextureData> layers(mLayers);
+	for (TextureData& layer : layers)
+	{
+		layer.internalFormat = mInternalFormat;
+		layer.format = format;
+		layer.compressed = mCompressed;
+	}
+
+	TextureUnits::bindForEdit(mTarget, mTextureID);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	std::vector<unsigned char> pixels;
+	for (int level = firstLevel; level < mLevels; level++)
+	{
+		int width = std::max(1, mWidth >> level);
+		int height = std::max(1, mHeight >> level);
+
+		// every layer of the level is returned at once
+		if (mCompressed)
+		{
+			GLint size = 0;
+			glGetTexLevelParameteriv(mTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			pixels.resize(size);
+			glGetCompressedTexImage(mTarget, level, pixels.data());
+		}
+		else
+		{
+			pixels.resize(static_cast<size_t>(width) * height * pixelSize(format) * mLayers);
+			glGetTexImage(mTarget, level, format, GL_UNSIGNED_BYTE, pixels.data());
+		}
+
+		// split into layers
+		size_t layerSize = pixels.size() / mLayers;
+		for (int i = 0; i < mLayers; i++)
+		{
+			TextureLevel source;
+			source.width = width;
+			source.height = height;
+			source.data.assign(pixels.begin() + layerSize * i, pixels.begin() + layerSize * (i + 1));
+			layers[i].levels.push_back(std::move(source));
+		}
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// recreate the texture with the reduced mip chain, keeping the times of the original load
+	TextureUnits::forgetTexture(mTextureID);
+	glDeleteTextures(1, &mTextureID);
+	mTextureID = 0;
+
+	readMipQuery(true);
+	double times[3] = { mDecodeMs, mMipMs, mUploadMs };
+	size_t skippedBytes = mSkippedBytes;
+	if (mTarget == GL_TEXTURE_2D_ARRAY)
+		uploadArray(layers);
+	else
+		upload(layers[0]);
+	mDecodeMs = times[0];
+	mMipMs = times[1];
+	mUploadMs = times[2];
+	mSkippedBytes = skippedBytes;
+
+	mEvicted = true;
+	return true;
+}
+
+Texture::State Texture::getState() const
+{
+	return mState;
+}
+
+bool Texture::isReady() const
+{
+	return mState == State::Ready;
 }
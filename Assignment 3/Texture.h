@@ -1,16 +1,69 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 #include "utilities.h"
 
+struct TextureData;
+enum class MipFilter;
+
+// storage and load timing of a texture, for sizing texture budgets
+struct TextureStats
+{
+	GLenum target = 0;
+	GLenum internalFormat = 0;
+	bool compressed = false;
+	int width = 0;
+	int height = 0;
+	int levels = 0;
+	int layers = 0;				// array layers or cube faces
+	size_t bytes = 0;			// estimated video memory including mips
+	size_t skippedBytes = 0;	// estimated memory saved by the texture quality
+	double decodeMs = 0.0;		// reading, decoding and compressing on the CPU
+	double mipMs = 0.0;			// building the mip chain, CPU time or the GPU time of glGenerateMipmap
+	double uploadMs = 0.0;		// issuing uploads on the GL thread
+};
+
 class Texture
 {
 public:
+	// loading state of a texture
+	enum class State
+	{
+		Empty,		// no image data
+		Pending,	// waiting for an asynchronous load, placeholder or evicted mips are bound
+		Ready,		// image data uploaded
+		Failed		// an asynchronous load failed, the error texture is bound until a load or reload succeeds
+	};
+
+	// how image files are cooked
+	enum class Type
+	{
+		Color,		// colour image, mip levels averaged in linear light
+		NormalMap,	// tangent space normals, only X and Y are stored (RG8 or BC5)
+		HeightMap	// 8-bit heights, converted to a normal map on load and stored as NormalMap
+	};
+
+	// texture quality for devices with little video memory, the finest levels of file textures are skipped
+	enum class Quality
+	{
+		Full,		// every level
+		Half,		// the first level is skipped, a quarter of the memory
+		Quarter		// the first two levels are skipped, a sixteenth of the memory
+	};
+
 	Texture();
 	~Texture();
 
-	// binds the texture for use
-	void bind();
+	// textures own their GL name, share them through std::shared_ptr
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+
+	// binds the texture and its sampler to a texture unit
+	void bind(int unit = 0);
 	// set texture parameters
 	void setFilterParams(GLuint magFilter, GLuint minFilter);
 	void setWrapParams(GLuint wrapS, GLuint wrapT);
@@ -19,18 +72,191 @@ public:
 	// generate a 2D texture from an image file
 	void generate(const std::string filename);
 	// generate a cube environment map from image files
+	// the mip chain is prefiltered for glossy reflections, see EnvironmentMap::shininessToLod
 	void generate(const std::string fileFront, const std::string fileBack,
 		const std::string fileLeft, const std::string fileRight,
 		const std::string fileTop, const std::string fileBottom);
+	// generate a prefiltered cube environment map from one equirectangular panorama file
+	void generatePanorama(const std::string filename);
+	// generate a 2D texture array, one layer per image file in order
+	// all images must have the same size and format
+	void generateArray(const std::vector<std::string>& filenames);
+
+	// enable or disable cooking image files into the compressed texture cache
+	static void setCompressionEnabled(bool enabled);
+	// whether file textures should be cooked to compressed formats on this context
+	static bool useCompression();
+	// set the filter used to generate mip levels of image files
+	static void setMipFilter(MipFilter filter);
+	// set the texture quality used by later loads, see TextureResidency::reloadAll to apply it to loaded textures
+	static void setQuality(Quality quality);
+	static Quality getQuality();
+	// number of finest levels the texture quality skips
+	static int skippedLevels();
+	// set the slope scale of normal maps derived from height maps, see HeightMap::toNormalMap
+	static void setHeightMapStrength(float strength);
+
+	// how image files are cooked, set before generating or loading the texture
+	void setType(Type type);
+	Type getType() const;
+
+	// decode an image file into texture data (safe to call from worker threads)
+	// if maxSize is set, textures found in the compressed texture cache only read the levels up to that size,
+	// the finer levels are left empty, see isPartial
+	// the finest skipLevels levels are dropped, at least one level is kept, cached textures never read them
+	static bool decode(const std::string& filename, bool compress, TextureData& data, Type type = Type::Color,
+		int maxSize = 0, int skipLevels = 0);
+	// decode an equirectangular panorama file to a prefiltered cube chain, six faces per level
+	// faces are at most EnvironmentMap::cMaxPanoramaFaceSize, compress encodes every face as BC1
+	// (safe to call from worker threads)
+	static bool decodePanorama(const std::vector<unsigned char>& fileData, bool compress, TextureData& data);
+	// whether decoded data is missing its finer levels
+	static bool isPartial(const TextureData& data);
+	// create a 2D texture from prepared texture data
+	// if pboOffsets is given, level data is sourced from the bound pixel unpack buffer
+	// except for levels in a memory-mapped file, which are read straight from the mapping
+	void upload(const TextureData& data, const std::vector<GLintptr>* pboOffsets = nullptr);
+	// create a 2D texture array from prepared texture data, one entry per layer
+	// pboOffsets are indexed by layer * number of levels + level
+	bool uploadArray(const std::vector<TextureData>& layers, const std::vector<GLintptr>* pboOffsets = nullptr);
+
+	// replace the image data of a loaded 2D texture or texture array in place, one entry per layer
+	// pboOffsets are indexed by layer * number of levels + level as for uploadArray
+	// returns false without uploading if the texture is not fully resident or its size or format differ
+	bool replace(const std::vector<TextureData>& layers, const std::vector<GLintptr>* pboOffsets = nullptr);
+
+	// progressive residency: allocate every level, then upload levels from the coarsest to the finest
+	// GL_TEXTURE_BASE_LEVEL is clamped to the finest resident level so missing levels are never sampled
+	// allocate a 2D texture (one layer) or a 2D texture array, returns false if the layers do not match
+	bool allocate(const std::vector<TextureData>& layers, bool array);
+	// upload one level of every layer and lower the clamp to it, the texture is ready once a level is resident
+	// pboOffsets are indexed by layer
+	void uploadLevel(const std::vector<TextureData>& layers, int level, const std::vector<GLintptr>* pboOffsets = nullptr);
+	// finest level with image data, 0 once the whole mip chain is resident
+	int getResidentLevel() const;
+	// add the CPU time spent producing data uploaded level by level after allocate
+	void recordDecode(const TextureData& data);
+
+	// mark the texture as waiting for an asynchronous load of the given target
+	// callback is invoked on the GL thread once the texture is ready
+	void setPending(GLenum target, std::function<void(Texture&)> callback = nullptr);
+	// mark a pending load as failed, textures with image data keep it
+	void setFailed();
+	// bind the image data of another texture in place of this one's, until this texture gets image data of its own
+	// the texture is ready at once, and keeps the source alive
+	void alias(const std::shared_ptr<Texture>& source);
+	bool isAlias() const;
+	State getState() const;
+	bool isReady() const;
+	// counts new loads and whole uploads, levels streamed for an older generation are stale
+	unsigned int getGeneration() const;
+
+	// advance the frame counter used to record when textures were last bound
+	static void nextFrame();
+	static unsigned int getFrame();
+
+	// residency information
+	// estimated video memory used by the texture including mips
+	size_t getSizeBytes() const;
+	// frame the texture was last bound
+	unsigned int getLastUsedFrame() const;
+	// image files the texture was loaded from (one per layer), empty if not reloadable
+	const std::vector<std::string>& getSources() const;
+	void setSources(const std::vector<std::string>& sources);
+	GLenum getTarget() const;
+	int getLevelCount() const;
+	// read back the RGBA8 pixels of a level, layers or cube faces one after another
+	// returns false if the texture has no image data
+	bool read(int level, std::vector<unsigned char>& pixels, int& width, int& height) const;
+	// dimensions, format, estimated memory and the time spent loading the current contents
+	TextureStats getStats() const;
+	// drop every level larger than maxSize, keeping the low resolution tail of the mip chain
+	// returns false if the texture cannot be reduced
+	bool evict(int maxSize);
+	bool isEvicted() const;
 
 private:
 	// texture ID and parameters
 	GLuint mTextureID = 0;
 	GLenum mTarget = 0;
+	Type mType = Type::Color;
 	GLuint mMagFilter = GL_LINEAR;
 	GLuint mMinFilter = GL_LINEAR_MIPMAP_LINEAR;
 	GLuint mWrapS = GL_REPEAT;
 	GLuint mWrapT = GL_REPEAT;
+	GLuint mWrapR = GL_REPEAT;
+	GLuint mSampler = 0;	// shared sampler object for the parameters, 0 until first bound
+
+	// loading state and completion callback
+	State mState = State::Empty;
+	std::function<void(Texture&)> mReadyCallback;
+	std::shared_ptr<Texture> mAlias;	// texture bound in place of this one, see alias
+	unsigned int mGeneration = 0;	// incremented by setPending, upload, uploadArray and replace
+
+	// storage description, used to estimate memory and to evict
+	GLenum mInternalFormat = 0;
+	bool mCompressed = false;
+	int mWidth = 0;
+	int mHeight = 0;
+	int mLevels = 0;
+	int mLayers = 0;
+	int mResidentLevel = 0;	// finest level with image data while streaming
+	size_t mSkippedBytes = 0;	// levels dropped by the texture quality
+
+	// time spent loading the current contents
+	double mDecodeMs = 0.0;
+	mutable double mMipMs = 0.0;	// the GPU time of glGenerateMipmap is added once its query is read
+	double mUploadMs = 0.0;
+	size_t mSizeBytes = 0;
+	// GL_TIME_ELAPSED query around glGenerateMipmap, read by getStats when its result is available
+	mutable GLuint mMipQuery = 0;
+	mutable bool mMipQueryPending = false;
+
+	// residency state
+	std::vector<std::string> mSources;
+	unsigned int mLastUsedFrame = 0;
+	bool mEvicted = false;
+
+	// whether image files are loaded through the compressed texture cache
+	static bool sCompressionEnabled;
+	// filter used to generate mip levels on the CPU
+	static MipFilter sMipFilter;
+	// slope scale of normal maps derived from height maps
+	static float sHeightMapStrength;
+	// quality of file textures loaded from now on
+	static Quality sQuality;
+	// 1x1 textures bound in place of pending textures, and of textures whose load failed
+	static GLuint sPlaceholder2D;
+	static GLuint sPlaceholderArray;
+	static GLuint sError2D;
+	static GLuint sErrorArray;
+	// current frame number
+	static unsigned int sFrame;
+
+	// decode an image file by whichever path suits it, see decode
+	static bool decodeFile(const std::string& filename, bool compress, TextureData& data, Type type, int maxSize,
+		int skipLevels);
+	// load an image file through the compressed texture cache
+	static bool decodeCompressed(const std::string& filename, TextureData& data, int maxSize, int skipLevels);
+	// load a normal map or build one from a height map, through the compressed texture cache if compress is set
+	static bool decodeNormalMap(const std::string& filename, bool compress, TextureData& data, Type type, int maxSize,
+		int skipLevels);
+	// map an uncompressed bitmap file for direct upload
+	static bool decodeBitmap(const std::string& filename, TextureData& data);
+	// create a cube map from prefiltered levels, six faces per level
+	void uploadCube(const TextureData& data);
+	// placeholder texture for a target, or the error texture if failed is set, created on first use
+	static GLuint placeholder(GLenum target, bool failed = false);
+	// mark the texture ready and notify anyone waiting on an asynchronous load
+	void setReady();
+	// start recording the load times and skipped levels of new contents
+	void resetLoadStats();
+	// generate the mip chain of the bound texture with the driver, timed on the GPU
+	void generateMipmap(GLenum target);
+	// add the result of the mip query to the mip time, waiting for it if wait is set
+	void readMipQuery(bool wait) const;
+	// record the storage of the texture and estimate its memory use
+	void setStorage(GLenum internalFormat, bool compressed, int width, int height, int levels, int layers);
 };
 
 #endif
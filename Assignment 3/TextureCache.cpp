@@ -0,0 +1,286 @@
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// cache file header, followed by every level header and then level data from the coarsest level
+	// to the finest, so the low resolution tail can be read without reading the whole file
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t internalFormat;
+		uint32_t format;
+		uint32_t compressed;
+		uint32_t numLevels;
+	};
+
+	struct CacheLevelHeader
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t size;
+	};
+
+	const char cMagic[4] = { 'T', 'X', 'C', 'H' };
+	const uint32_t cVersion = 2;
+
+	// limits that reject corrupt files before anything is allocated from them
+	// a 32768 texel chain has 16 levels, cube maps store six faces per level
+	const uint32_t cMaxLevels = 16 * 6;
+	const uint32_t cMaxLevelSize = 1 << 15;
+
+	std::string gCacheDirectory = "./cache";
+
+	// path of the cooked texture file for a key
+	std::string cachePath(uint64_t key)
+	{
+		return TextureCache::path(key);
+	}
+
+	// bytes of a tightly packed level in the format of a cache file, 0 if the format is unknown
+	uint64_t levelBytes(const CacheHeader& header, uint32_t width, uint32_t height)
+	{
+		if (header.compressed)
+		{
+			for (BlockFormat format : { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5 })
+			{
+				if (TextureCompressor::glFormat(format) == header.internalFormat)
+					return static_cast<uint64_t>(TextureCompressor::compressedSize(format, width, height));
+			}
+			return 0;
+		}
+
+		uint64_t texels = static_cast<uint64_t>(width) * height;
+		switch (header.format)
+		{
+		case GL_RED:
+			return texels;
+		case GL_RG:
+			return texels * 2;
+		case GL_RGB:
+		case GL_BGR:
+			return texels * 3;
+		case GL_RGBA:
+		case GL_BGRA:
+			return texels * 4;
+		default:
+			return 0;
+		}
+	}
+
+	// check the level table is a mip chain, finest first, of levels holding exactly their texels
+	// cube maps store six equal faces per level, which is the only way two levels can share a size
+	bool validLevels(const CacheHeader& header, const std::vector<CacheLevelHeader>& levels)
+	{
+		if (levels.empty() || levels[0].width == 0 || levels[0].height == 0
+			|| levels[0].width > cMaxLevelSize || levels[0].height > cMaxLevelSize)
+		{
+			return false;
+		}
+
+		bool cube = levels.size() > 1 && levels[1].width == levels[0].width && levels[1].height == levels[0].height;
+		size_t faces = cube ? 6 : 1;
+		if (levels.size() % faces != 0)
+			return false;
+
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			uint32_t width = levels[0].width;
+			uint32_t height = levels[0].height;
+			if (i >= faces)
+			{
+				width = std::max(1u, levels[i - faces].width >> 1);
+				height = std::max(1u, levels[i - faces].height >> 1);
+			}
+
+			if (levels[i].width != width || levels[i].height != height
+				|| levels[i].size != levelBytes(header, width, height))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+void TextureCache::setDirectory(const std::string& directory)
+{
+	gCacheDirectory = directory;
+}
+
+std::string TextureCache::path(uint64_t key, const std::string& extension)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.", static_cast<unsigned long long>(key));
+	return gCacheDirectory + "/" + name + extension;
+}
+
+uint64_t TextureCache::hash(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t h = seed;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+
+	return h;
+}
+
+bool TextureCache::readFile(const std::string& filename, std::vector<unsigned char>& contents)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+
+	if (!file.is_open())
+		return false;
+
+	// read whole file
+	std::streamsize size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	contents.resize(static_cast<size_t>(size));
+	file.read(reinterpret_cast<char*>(contents.data()), size);
+
+	return static_cast<bool>(file);
+}
+
+uint64_t TextureCache::makeKey(uint64_t sourceHash, uint32_t variant)
+{
+	uint32_t tag[2] = { variant, cVersion };
+	return hash(tag, sizeof(tag), sourceHash);
+}
+
+bool TextureCache::load(uint64_t key, TextureData& data, int maxSize, int skipLevels)
+{
+	std::ifstream file(cachePath(key), std::ios::in | std::ios::binary);
+
+	if (!file.is_open())
+		return false;
+
+	// validate header
+	CacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0
+		|| header.version != cVersion || header.key != key)
+	{
+		return false;
+	}
+
+	if (header.numLevels == 0 || header.numLevels > cMaxLevels)
+	{
+		std::cerr << "Corrupt texture cache file: " << cachePath(key) << std::endl;
+		return false;
+	}
+
+	// read and validate the level table, so level sizes can be trusted when reading and uploading
+	std::vector<CacheLevelHeader> levelHeaders(header.numLevels);
+	file.read(reinterpret_cast<char*>(levelHeaders.data()), sizeof(CacheLevelHeader) * levelHeaders.size());
+
+	if (!file || !validLevels(header, levelHeaders))
+	{
+		std::cerr << "Corrupt texture cache file: " << cachePath(key) << std::endl;
+		return false;
+	}
+
+	data.internalFormat = header.internalFormat;
+	data.format = header.format;
+	data.compressed = header.compressed != 0;
+	data.levels.resize(header.numLevels);
+
+	for (size_t i = 0; i < levelHeaders.size(); i++)
+	{
+		data.levels[i].width = static_cast<int>(levelHeaders[i].width);
+		data.levels[i].height = static_cast<int>(levelHeaders[i].height);
+	}
+
+	// skipped levels are the last in the file, so reading stops before them
+	size_t skip = static_cast<size_t>(std::max(0, std::min(skipLevels, static_cast<int>(header.numLevels) - 1)));
+	for (size_t i = 0; i < skip; i++)
+		data.skippedBytes += levelHeaders[i].size;
+
+	// read levels from the coarsest, stopping at the first one that is too large
+	for (size_t i = levelHeaders.size(); i-- > skip;)
+	{
+		TextureLevel& level = data.levels[i];
+		if (maxSize > 0 && std::max(level.width, level.height) > maxSize)
+			break;
+
+		level.data.resize(levelHeaders[i].size);
+		file.read(reinterpret_cast<char*>(level.data.data()), levelHeaders[i].size);
+
+		if (!file)
+		{
+			std::cerr << "Corrupt texture cache file: " << cachePath(key) << std::endl;
+			data.levels.clear();
+			return false;
+		}
+	}
+
+	data.levels.erase(data.levels.begin(), data.levels.begin() + skip);
+	return !data.levels.empty();
+}
+
+bool TextureCache::store(uint64_t key, const TextureData& data)
+{
+	std::error_code error;
+	std::filesystem::create_directories(gCacheDirectory, error);
+
+	// write to a temporary file first so a partial write is never loaded
+	std::string path = cachePath(key);
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cerr << "Unable to write texture cache: " << path << std::endl;
+		return false;
+	}
+
+	CacheHeader header;
+	std::memcpy(header.magic, cMagic, sizeof(cMagic));
+	header.version = cVersion;
+	header.key = key;
+	header.internalFormat = data.internalFormat;
+	header.format = data.format;
+	header.compressed = data.compressed ? 1 : 0;
+	header.numLevels = static_cast<uint32_t>(data.levels.size());
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (const TextureLevel& level : data.levels)
+	{
+		CacheLevelHeader levelHeader;
+		levelHeader.width = static_cast<uint32_t>(level.width);
+		levelHeader.height = static_cast<uint32_t>(level.height);
+		levelHeader.size = static_cast<uint32_t>(level.data.size());
+		file.write(reinterpret_cast<const char*>(&levelHeader), sizeof(levelHeader));
+	}
+
+	for (size_t i = data.levels.size(); i-- > 0;)
+	{
+		const TextureLevel& level = data.levels[i];
+		file.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+	}
+
+	file.close();
+
+	if (!file)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
@@ -0,0 +1,72 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <GLEW/glew.h>
+
+class MappedFile;
+
+// a single mip level of texture data
+struct TextureLevel
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> data;
+
+	// pixels held outside data, e.g. in a memory-mapped file
+	const unsigned char* external = nullptr;
+	size_t externalSize = 0;
+	GLenum externalFormat = 0;	// pixel format of the external pixels
+
+	const unsigned char* pixels() const { return external ? external : data.data(); }
+	size_t size() const { return external ? externalSize : data.size(); }
+};
+
+// CPU-side texture image and its mip chain, ready to be uploaded
+struct TextureData
+{
+	GLenum internalFormat = 0;	// OpenGL internal format
+	GLenum format = 0;			// pixel format of uncompressed data
+	bool compressed = false;	// whether levels hold compressed blocks
+	std::vector<TextureLevel> levels;
+	std::shared_ptr<MappedFile> mapping;	// keeps external level pixels alive
+
+	// estimated memory of the finest levels dropped by the texture quality, not stored in the cache
+	size_t skippedBytes = 0;
+
+	// CPU time spent producing the data, not stored in the cache
+	double decodeMs = 0.0;		// reading, decoding and compressing
+	double mipMs = 0.0;			// building the mip chain
+};
+
+/*****************************************************************
+ * on-disk cache of cooked textures, keyed by a content hash of
+ * the source image and the format it was cooked to
+ *****************************************************************/
+namespace TextureCache
+{
+	// set the directory that cache files are written to
+	void setDirectory(const std::string& directory);
+	// path of the cache file for a key, with the given file extension
+	std::string path(uint64_t key, const std::string& extension = "tex");
+
+	// 64-bit FNV-1a hash of a block of memory
+	uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+	// read the contents of a file, returns false if it cannot be read
+	bool readFile(const std::string& filename, std::vector<unsigned char>& contents);
+	// combine a source hash with the cook variant (e.g. colour, normal map) to form a cache key
+	uint64_t makeKey(uint64_t sourceHash, uint32_t variant);
+
+	// load cooked texture data for a key, returns false on a cache miss
+	// levels are stored coarsest first, if maxSize is set reading stops at the first level larger than it
+	// and the finer levels are left with their size but no data
+	// the finest skipLevels levels are dropped without being read, at least one level is kept
+	bool load(uint64_t key, TextureData& data, int maxSize = 0, int skipLevels = 0);
+	// write cooked texture data for a key
+	bool store(uint64_t key, const TextureData& data);
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// copy a 4x4 block of RGBA pixels, clamping at the image edges
+	void extractBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int sy = std::min(by * 4 + y, height - 1);
+
+			for (int x = 0; x < 4; x++)
+			{
+				int sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(&block[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+			}
+		}
+	}
+
+	// pack an 8-bit colour into 5:6:5
+	uint16_t packRGB565(const unsigned char* color)
+	{
+		return static_cast<uint16_t>(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+	}
+
+	// expand a 5:6:5 colour back to 8 bits per channel
+	void unpackRGB565(uint16_t packed, int color[3])
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	void writeU16(unsigned char* out, uint16_t value)
+	{
+		out[0] = static_cast<unsigned char>(value & 0xFF);
+		out[1] = static_cast<unsigned char>(value >> 8);
+	}
+
+	// encode the colour part of a block (8 bytes)
+	// endpoints are the inset bounding box of the block colours
+	void encodeColorBlock(const unsigned char block[64], unsigned char* out)
+	{
+		unsigned char minColor[3] = { 255, 255, 255 };
+		unsigned char maxColor[3] = { 0, 0, 0 };
+
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+				maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+			}
+		}
+
+		// inset the bounding box to reduce the error of the end points
+		for (int c = 0; c < 3; c++)
+		{
+			int inset = (maxColor[c] - minColor[c]) >> 4;
+			minColor[c] = static_cast<unsigned char>(std::min(255, minColor[c] + inset));
+			maxColor[c] = static_cast<unsigned char>(std::max(0, maxColor[c] - inset));
+		}
+
+		uint16_t color0 = packRGB565(maxColor);
+		uint16_t color1 = packRGB565(minColor);
+
+		// solid block, every index refers to color0
+		if (color0 == color1)
+		{
+			writeU16(out, color0);
+			writeU16(out + 2, color1);
+			std::memset(out + 4, 0, 4);
+			return;
+		}
+
+		// four colour mode requires color0 > color1
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		// build palette from the quantised end points
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		// choose the nearest palette entry for every pixel
+		uint32_t indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = INT32_MAX;
+
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = block[i * 4 + 0] - palette[p][0];
+				int dg = block[i * 4 + 1] - palette[p][1];
+				int db = block[i * 4 + 2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+
+			indices |= static_cast<uint32_t>(bestIndex) << (i * 2);
+		}
+
+		writeU16(out, color0);
+		writeU16(out + 2, color1);
+		out[4] = static_cast<unsigned char>(indices & 0xFF);
+		out[5] = static_cast<unsigned char>((indices >> 8) & 0xFF);
+		out[6] = static_cast<unsigned char>((indices >> 16) & 0xFF);
+		out[7] = static_cast<unsigned char>((indices >> 24) & 0xFF);
+	}
+
+	// encode a single channel of a block (8 bytes), as used by BC3 alpha and BC4/BC5
+	void encodeChannelBlock(const unsigned char block[64], int channel, unsigned char* out)
+	{
+		int minValue = 255;
+		int maxValue = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			minValue = std::min(minValue, static_cast<int>(block[i * 4 + channel]));
+			maxValue = std::max(maxValue, static_cast<int>(block[i * 4 + channel]));
+		}
+
+		out[0] = static_cast<unsigned char>(maxValue);
+		out[1] = static_cast<unsigned char>(minValue);
+
+		// eight value mode (value0 > value1), palette interpolated in sevenths
+		int palette[8];
+		palette[0] = maxValue;
+		palette[1] = minValue;
+		for (int p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+		}
+
+		uint64_t indices = 0;
+		if (maxValue != minValue)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int value = block[i * 4 + channel];
+				int bestIndex = 0;
+				int bestError = INT32_MAX;
+
+				for (int p = 0; p < 8; p++)
+				{
+					int error = std::abs(value - palette[p]);
+
+					if (error < bestError)
+					{
+						bestError = error;
+						bestIndex = p;
+					}
+				}
+
+				indices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+			}
+		}
+
+		// 48 bits of 3-bit indices
+		for (int b = 0; b < 6; b++)
+		{
+			out[2 + b] = static_cast<unsigned char>((indices >> (b * 8)) & 0xFF);
+		}
+	}
+}
+
+GLenum TextureCompressor::glFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC5:
+	default:
+		return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+int TextureCompressor::blockSize(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+int TextureCompressor::compressedSize(BlockFormat format, int width, int height)
+{
+	int blocksX = std::max(1, (width + 3) / 4);
+	int blocksY = std::max(1, (height + 3) / 4);
+	return blocksX * blocksY * blockSize(format);
+}
+
+bool TextureCompressor::isSupported(BlockFormat format)
+{
+	// RGTC is core since OpenGL 3.0, S3TC is an extension
+	if (format == BlockFormat::BC5)
+		return true;
+
+	return GLEW_EXT_texture_compression_s3tc != GL_FALSE;
+}
+
+void TextureCompressor::compress(BlockFormat format, const unsigned char* rgba, int width, int height,
+	std::vector<unsigned char>& output)
+{
+	int blocksX = std::max(1, (width + 3) / 4);
+	int blocksY = std::max(1, (height + 3) / 4);
+	int size = blockSize(format);
+
+	output.resize(compressedSize(format, width, height));
+
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			unsigned char* out = &output[(by * blocksX + bx) * size];
+			extractBlock(rgba, width, height, bx, by, block);
+
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				encodeColorBlock(block, out);
+				break;
+			case BlockFormat::BC3:
+				encodeChannelBlock(block, 3, out);
+				encodeColorBlock(block, out + 8);
+				break;
+			case BlockFormat::BC5:
+				encodeChannelBlock(block, 0, out);
+				encodeChannelBlock(block, 1, out + 8);
+				break;
+			}
+		}
+	}
+}
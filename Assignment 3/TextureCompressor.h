@@ -0,0 +1,35 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <vector>
+#include <GLEW/glew.h>
+
+// block-compressed texture formats produced by the CPU encoder
+enum class BlockFormat
+{
+	BC1,	// RGB, 4 bits per pixel (DXT1)
+	BC3,	// RGBA, 8 bits per pixel (DXT5)
+	BC5		// two channel RG, 8 bits per pixel (RGTC2)
+};
+
+/*****************************************************************
+ * CPU encoder for BC1/BC3/BC5 blocks
+ * input images are tightly packed RGBA8 in upload row order
+ *****************************************************************/
+namespace TextureCompressor
+{
+	// OpenGL internal format of a block format
+	GLenum glFormat(BlockFormat format);
+	// bytes per 4x4 block
+	int blockSize(BlockFormat format);
+	// size in bytes of a compressed image
+	int compressedSize(BlockFormat format, int width, int height);
+	// whether the current context can sample the block format
+	bool isSupported(BlockFormat format);
+
+	// compress an RGBA8 image, output is resized to compressedSize()
+	void compress(BlockFormat format, const unsigned char* rgba, int width, int height,
+		std::vector<unsigned char>& output);
+}
+
+#endif
@@ -0,0 +1,453 @@
+#include "TextureLoader.h"
+#include "Timing.h"
+
+#include <algorithm>
+#include <cstring>
+
+TextureLoader::TextureLoader()
+{}
+
+TextureLoader::~TextureLoader()
+{
+	// stop and join worker threads
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+
+	for (std::thread& thread : mThreads)
+	{
+		thread.join();
+	}
+
+	// delete pixel buffer objects
+	if (mPBOs[0] != 0)
+		glDeleteBuffers(cNumPBOs, mPBOs);
+}
+
+void TextureLoader::start(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		mThreads.emplace_back(&TextureLoader::workerLoop, this);
+	}
+}
+
+void TextureLoader::load(Texture& texture, const std::string& filename, std::function<void(Texture&)> callback)
+{
+	queue(texture, { filename }, false, callback, nullptr);
+}
+
+void TextureLoader::loadArray(Texture& texture, const std::vector<std::string>& filenames,
+	std::function<void(Texture&)> callback)
+{
+	queue(texture, filenames, true, callback, nullptr);
+}
+
+void TextureLoader::load(const std::shared_ptr<Texture>& texture, const std::string& filename,
+	std::function<void(Texture&)> callback)
+{
+	queue(*texture, { filename }, false, callback, texture);
+}
+
+void TextureLoader::loadArray(const std::shared_ptr<Texture>& texture, const std::vector<std::string>& filenames,
+	std::function<void(Texture&)> callback)
+{
+	queue(*texture, filenames, true, callback, texture);
+}
+
+void TextureLoader::queue(Texture& texture, const std::vector<std::string>& filenames, bool array,
+	std::function<void(Texture&)> callback, const std::shared_ptr<Texture>& handle)
+{
+	// start with default threads if not already started
+	if (mThreads.empty())
+		start();
+
+	// bind placeholder until ready
+	texture.setPending(array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, callback);
+	texture.setSources(filenames);
+
+	std::unique_ptr<Job> job(new Job());
+	job->texture = &texture;
+	job->handle = handle;
+	job->filenames = filenames;
+	job->array = array;
+	job->compress = Texture::useCompression();	// query GL state on this thread
+	job->type = texture.getType();
+	job->skipLevels = Texture::skippedLevels();
+	job->progressive = mProgressive;
+	job->generation = texture.getGeneration();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// a new batch starts when nothing is pending
+		if (mPendingCount == 0)
+		{
+			mBatchStart = std::chrono::steady_clock::now();
+			mFirstFrameMs = 0.0;
+			mFullDetailMs = 0.0;
+		}
+
+		mQueue.push_back(std::move(job));
+		mPendingCount++;
+		mWaitingCount++;
+	}
+	mCondition.notify_one();
+}
+
+void TextureLoader::reload(const std::shared_ptr<Texture>& texture, std::function<void(Texture&, bool)> callback)
+{
+	if (mThreads.empty())
+		start();
+
+	std::unique_ptr<Job> job(new Job());
+	job->texture = texture.get();
+	job->handle = texture;
+	job->filenames = texture->getSources();
+	job->array = texture->getTarget() == GL_TEXTURE_2D_ARRAY;
+	job->compress = Texture::useCompression();
+	job->type = texture->getType();
+	job->skipLevels = Texture::skippedLevels();
+	job->reload = true;
+	job->reloaded = callback;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(std::move(job));
+	}
+	mCondition.notify_one();
+}
+
+int TextureLoader::update(double budgetMs)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	int uploaded = 0;
+
+	// stream one finer level of each progressive load per frame, dropping loads whose texture was
+	// queued again, reloaded or replaced since, whatever its resident level
+	size_t numStreams = mStreaming.size();
+	for (size_t i = 0; i < numStreams && Timing::elapsedMs(startTime) < budgetMs; i++)
+	{
+		std::unique_ptr<Job> job = std::move(mStreaming.front());
+		mStreaming.pop_front();
+
+		if (job->texture->getGeneration() == job->generation)
+		{
+			uploadLevel(*job, job->nextLevel);
+			job->nextLevel--;
+		}
+		else
+		{
+			job->nextLevel = -1;
+		}
+
+		if (job->nextLevel >= 0)
+			mStreaming.push_back(std::move(job));
+		else
+			onComplete();
+	}
+
+	while (true)
+	{
+		// stop once the frame's upload budget is used
+		if (Timing::elapsedMs(startTime) >= budgetMs)
+			break;
+
+		// take the next decoded job
+		std::unique_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mDecoded.empty())
+				break;
+
+			job = std::move(mDecoded.front());
+			mDecoded.pop_front();
+		}
+
+		// reloads keep the current contents on failure and stay out of the batch timing
+		if (job->reload)
+		{
+			if (job->success)
+			{
+				upload(*job);
+				uploaded++;
+			}
+			else
+			{
+				for (const std::string& filename : job->filenames)
+					std::cout << "Unable to reload: " << filename << std::endl;
+			}
+
+			if (job->reloaded)
+				job->reloaded(*job->texture, job->success);
+			continue;
+		}
+
+		// loads overtaken by a later load or reload are dropped, the texture already has newer contents
+		if (job->texture->getGeneration() != job->generation)
+		{
+			if (job->tail || !job->continues)
+				onFirstLevel();
+			if (!job->tail)
+				onComplete();
+			continue;
+		}
+
+		// the coarse tail of a progressive load, its full chain is still being read
+		if (job->tail)
+		{
+			beginStream(*job);
+			onFirstLevel();
+			continue;
+		}
+
+		bool streaming = false;
+		if (job->success)
+		{
+			if (beginStream(*job))
+				streaming = job->nextLevel >= 0;
+			else
+				upload(*job);
+			uploaded++;
+		}
+		else
+		{
+			for (const std::string& filename : job->filenames)
+				std::cout << "Unable to load: " << filename << std::endl;
+			job->texture->setFailed();
+		}
+
+		if (!job->continues)
+			onFirstLevel();
+
+		if (streaming)
+			mStreaming.push_back(std::move(job));
+		else
+			onComplete();
+	}
+
+	return uploaded;
+}
+
+void TextureLoader::setProgressive(bool progressive)
+{
+	mProgressive = progressive;
+}
+
+double TextureLoader::getTimeToFirstFrame() const
+{
+	return mFirstFrameMs;
+}
+
+double TextureLoader::getTimeToFullDetail() const
+{
+	return mFullDetailMs;
+}
+
+void TextureLoader::onFirstLevel()
+{
+	if (--mWaitingCount == 0)
+		mFirstFrameMs = Timing::elapsedMs(mBatchStart);
+}
+
+void TextureLoader::onComplete()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (--mPendingCount == 0)
+		mFullDetailMs = Timing::elapsedMs(mBatchStart);
+}
+
+int TextureLoader::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPendingCount;
+}
+
+void TextureLoader::workerLoop()
+{
+	while (true)
+	{
+		std::unique_ptr<Job> job;
+
+		// wait for a job
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+
+			if (mStopping)
+				return;
+
+			job = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		// progressive loads of cooked textures read the coarse tail first and hand it over
+		// before reading the full chain, cache files are stored coarsest level first
+		bool decoded = false;
+		if (job->progressive && job->compress)
+		{
+			std::unique_ptr<Job> tail(new Job(*job));
+			tail->tail = true;
+			tail->layers.resize(tail->filenames.size());
+			tail->success = true;
+			bool partial = false;
+			for (size_t i = 0; i < tail->filenames.size() && tail->success; i++)
+			{
+				tail->success = Texture::decode(tail->filenames[i], tail->compress, tail->layers[i], tail->type, cTailSize,
+					tail->skipLevels);
+				partial = partial || Texture::isPartial(tail->layers[i]);
+			}
+
+			if (tail->success && partial)
+			{
+				job->continues = true;
+				std::lock_guard<std::mutex> lock(mMutex);
+				mDecoded.push_back(std::move(tail));
+			}
+			else if (tail->success)
+			{
+				// cooked on this load, so the full chain is already in memory
+				job->layers = std::move(tail->layers);
+				job->success = true;
+				decoded = true;
+			}
+		}
+
+		// decode every layer on this thread
+		if (!decoded)
+		{
+			job->layers.resize(job->filenames.size());
+			job->success = true;
+			for (size_t i = 0; i < job->filenames.size(); i++)
+			{
+				job->success = job->success && Texture::decode(job->filenames[i], job->compress, job->layers[i], job->type, 0,
+					job->skipLevels);
+			}
+		}
+
+		// hand over to the GL thread
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDecoded.push_back(std::move(job));
+	}
+}
+
+bool TextureLoader::stage(const std::vector<const TextureLevel*>& levels, std::vector<GLintptr>& offsets)
+{
+	if (mPBOs[0] == 0)
+		glGenBuffers(cNumPBOs, mPBOs);
+
+	// compute level offsets within the staging buffer
+	// levels in a memory-mapped file are uploaded straight from the mapping, so they take no space
+	offsets.clear();
+	GLsizeiptr size = 0;
+	for (const TextureLevel* level : levels)
+	{
+		offsets.push_back(size);
+		if (!level->external)
+			size += static_cast<GLsizeiptr>((level->size() + 3) & ~static_cast<size_t>(3));
+	}
+	if (size == 0)
+		return false;
+
+	// orphan the next buffer in the ring and copy the pixels into it
+	GLuint pbo = mPBOs[mNextPBO];
+	mNextPBO = (mNextPBO + 1) % cNumPBOs;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	unsigned char* mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+	if (!mapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		if (!levels[i]->external)
+			std::memcpy(mapped + offsets[i], levels[i]->pixels(), levels[i]->size());
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	return true;
+}
+
+void TextureLoader::upload(Job& job)
+{
+	// stage every level of every layer, layer by layer
+	std::vector<const TextureLevel*> levels;
+	for (const TextureData& layer : job.layers)
+	{
+		for (const TextureLevel& level : layer.levels)
+			levels.push_back(&level);
+	}
+
+	// the driver transfers from the buffer without blocking this thread, or directly if it cannot be mapped
+	std::vector<GLintptr> offsets;
+	const std::vector<GLintptr>* source = stage(levels, offsets) ? &offsets : nullptr;
+
+	// reloads update the existing storage when it still fits, anything else is reallocated
+	// arrays whose layers do not match are not uploaded, a pending load is marked failed
+	if (!job.reload || !job.texture->replace(job.layers, source))
+	{
+		if (!job.array)
+			job.texture->upload(job.layers[0], source);
+		else if (!job.texture->uploadArray(job.layers, source))
+			job.texture->setFailed();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureLoader::uploadLevel(Job& job, int level)
+{
+	std::vector<const TextureLevel*> levels;
+	for (const TextureData& layer : job.layers)
+		levels.push_back(&layer.levels[level]);
+
+	std::vector<GLintptr> offsets;
+	const std::vector<GLintptr>* source = stage(levels, offsets) ? &offsets : nullptr;
+
+	job.texture->uploadLevel(job.layers, level, source);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool TextureLoader::beginStream(Job& job)
+{
+	// single level textures are uploaded in one go, their mips are generated by the driver
+	int numLevels = static_cast<int>(job.layers[0].levels.size());
+	if (!job.progressive || numLevels < 2)
+		return false;
+
+	Texture& texture = *job.texture;
+	bool tailResident = job.continues && texture.getLevelCount() == numLevels && texture.getResidentLevel() < numLevels;
+
+	if (tailResident)
+	{
+		for (const TextureData& layer : job.layers)
+			texture.recordDecode(layer);
+	}
+	else
+	{
+		if (!texture.allocate(job.layers, job.array))
+			return false;
+
+		// upload the coarsest level and every level up to the tail size
+		for (int level = numLevels - 1; level >= 0; level--)
+		{
+			const TextureLevel& size = job.layers[0].levels[level];
+			if (level < numLevels - 1 && (std::max(size.width, size.height) > cTailSize || size.size() == 0))
+				break;
+
+			uploadLevel(job, level);
+		}
+	}
+
+	job.nextLevel = texture.getResidentLevel() - 1;
+	return true;
+}
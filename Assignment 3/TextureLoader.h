@@ -0,0 +1,124 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Texture.h"
+#include "TextureCache.h"
+
+/*****************************************************************
+ * asynchronous texture loader
+ * image files are decoded on worker threads and uploaded on the
+ * GL thread through pixel buffer objects within a per-frame budget.
+ * mip chains are streamed progressively, the coarse tail is shown
+ * first and finer levels are uploaded over the following frames
+ *****************************************************************/
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	// start the worker threads (0 = one less than the number of cores)
+	void start(int numThreads = 0);
+	// queue an image file to be loaded into a texture
+	// the texture binds a placeholder until the upload completes
+	void load(Texture& texture, const std::string& filename, std::function<void(Texture&)> callback = nullptr);
+	// queue image files to be loaded into the layers of a 2D texture array
+	void loadArray(Texture& texture, const std::vector<std::string>& filenames,
+		std::function<void(Texture&)> callback = nullptr);
+	// as above for shared textures, the loader holds a handle until the upload completes
+	void load(const std::shared_ptr<Texture>& texture, const std::string& filename,
+		std::function<void(Texture&)> callback = nullptr);
+	void loadArray(const std::shared_ptr<Texture>& texture, const std::vector<std::string>& filenames,
+		std::function<void(Texture&)> callback = nullptr);
+	// decode the source files of a loaded texture again, its current contents stay bound until the upload
+	// the texture is updated in place if the size and format are unchanged, otherwise its storage is reallocated
+	// callback is invoked on the GL thread once the reload finished, with whether the files could be decoded
+	void reload(const std::shared_ptr<Texture>& texture, std::function<void(Texture&, bool)> callback = nullptr);
+	// upload decoded textures, call once per frame on the GL thread
+	// returns the number of textures uploaded
+	int update(double budgetMs);
+	// number of textures queued, waiting to be uploaded or still streaming finer levels
+	int getPendingCount();
+
+	// stream mip chains from the coarsest level (on by default), set before queueing loads
+	void setProgressive(bool progressive);
+	// milliseconds from the start of the current batch of loads until every texture had a level resident,
+	// and until every texture was at full detail, 0 until reached
+	// a batch starts when a load is queued while nothing is pending
+	double getTimeToFirstFrame() const;
+	double getTimeToFullDetail() const;
+
+private:
+	// largest level uploaded with the first frame of a progressive load
+	static const int cTailSize = 64;
+
+	// a queued texture load
+	struct Job
+	{
+		Texture* texture = nullptr;
+		std::shared_ptr<Texture> handle;	// keeps shared textures alive while loading
+		std::vector<std::string> filenames;	// one per layer
+		bool array = false;
+		bool compress = false;
+		Texture::Type type = Texture::Type::Color;
+		int skipLevels = 0;			// finest levels skipped by the texture quality
+		bool progressive = false;
+		bool tail = false;			// only the coarse levels of a progressive load, the full chain follows
+		bool continues = false;		// the coarse tail of this load was already handed over
+		bool reload = false;		// replaces the contents of a loaded texture, not counted as pending
+		std::function<void(Texture&, bool)> reloaded;
+		bool success = false;
+		std::vector<TextureData> layers;
+		int nextLevel = -1;			// next level to stream, coarser levels are resident
+		unsigned int generation = 0;	// texture generation when queued, see Texture::getGeneration
+	};
+
+	std::vector<std::thread> mThreads;
+	std::deque<std::unique_ptr<Job>> mQueue;		// waiting to be decoded
+	std::deque<std::unique_ptr<Job>> mDecoded;	// waiting to be uploaded
+	std::deque<std::unique_ptr<Job>> mStreaming;	// uploading finer levels, GL thread only
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping = false;
+	int mPendingCount = 0;
+	bool mProgressive = true;
+
+	// timing of the current batch of loads
+	std::chrono::steady_clock::time_point mBatchStart;
+	int mWaitingCount = 0;			// loads without a resident level
+	double mFirstFrameMs = 0.0;
+	double mFullDetailMs = 0.0;
+
+	// ring of pixel buffer objects used for staging uploads
+	static const int cNumPBOs = 4;
+	GLuint mPBOs[cNumPBOs] = {};
+	int mNextPBO = 0;
+
+	// create a job for a texture and queue it for the worker threads
+	void queue(Texture& texture, const std::vector<std::string>& filenames, bool array,
+		std::function<void(Texture&)> callback, const std::shared_ptr<Texture>& handle);
+	// worker thread loop
+	void workerLoop();
+	// copy levels into the next pixel buffer object and leave it bound, offsets are in order
+	// levels in a memory-mapped file are skipped, returns false with no buffer bound if nothing is staged
+	bool stage(const std::vector<const TextureLevel*>& levels, std::vector<GLintptr>& offsets);
+	// stage a decoded job through a pixel buffer object and upload it
+	void upload(Job& job);
+	// stage one level of every layer of a job and upload it
+	void uploadLevel(Job& job, int level);
+	// allocate a progressive job's texture and upload its coarse tail, sets the next level to stream
+	bool beginStream(Job& job);
+	// record that a load has a level resident, and that a load has finished
+	void onFirstLevel();
+	void onComplete();
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include "TextureRegistry.h"
+#include "TextureCache.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <chrono>
+
+TextureRegistry::TextureRegistry(TextureLoader& loader) :
+	mLoader(loader)
+{}
+
+std::shared_ptr<Texture> TextureRegistry::acquire(const std::string& filename, Texture::Type type)
+{
+	return acquire(std::vector<std::string>{ filename }, false, type);
+}
+
+std::shared_ptr<Texture> TextureRegistry::acquireArray(const std::vector<std::string>& filenames, Texture::Type type)
+{
+	return acquire(filenames, true, type);
+}
+
+int TextureRegistry::getTextureCount()
+{
+	prune();
+	return static_cast<int>(mEntries.size());
+}
+
+int TextureRegistry::getSharedCount() const
+{
+	return mSharedCount;
+}
+
+size_t TextureRegistry::getSavedBytes()
+{
+	prune();
+
+	// every acquire after the first would otherwise have loaded its own copy
+	size_t saved = 0;
+	for (const auto& entry : mEntries)
+	{
+		std::shared_ptr<Texture> texture = entry.second.texture.lock();
+		if (texture)
+			saved += texture->getSizeBytes() * (entry.second.acquires - 1);
+	}
+
+	return saved;
+}
+
+bool TextureRegistry::contentKey(const std::vector<std::string>& filenames, bool array, Texture::Type type,
+	uint64_t& key)
+{
+	// chain the hashes of every file, arrays, single textures and texture types never share a key
+	uint64_t hash = TextureCache::hash(&array, sizeof(array));
+	hash = TextureCache::hash(&type, sizeof(type), hash);
+
+	for (const std::string& filename : filenames)
+	{
+		MappedFile file;
+		if (!file.open(filename))
+			return false;
+
+		hash = TextureCache::hash(file.data(), file.size(), hash);
+	}
+
+	key = hash;
+	return true;
+}
+
+std::shared_ptr<Texture> TextureRegistry::acquire(const std::vector<std::string>& filenames, bool array,
+	Texture::Type type)
+{
+	if (filenames.empty())
+		return std::make_shared<Texture>();
+
+	// the path is looked up first so known files are not read again
+	std::string path = array ? "array:" : "";
+	if (type == Texture::Type::NormalMap)
+		path += "normal:";
+	else if (type == Texture::Type::HeightMap)
+		path += "height:";
+	for (const std::string& filename : filenames)
+	{
+		path += filename + "\n";
+	}
+
+	// the same path returns the same texture, whether or not its files have been hashed yet
+	std::shared_ptr<Texture> texture = mPathTextures[path].lock();
+	if (texture)
+	{
+		auto pathKey = mPathKeys.find(path);
+		if (pathKey != mPathKeys.end())
+		{
+			mEntries[pathKey->second].acquires++;
+			mSharedCount++;
+		}
+
+		// acquires made while hashing are counted once the contents are known
+		for (const std::unique_ptr<Hashing>& hashing : mHashing)
+		{
+			if (hashing->path == path)
+				hashing->acquires++;
+		}
+		return texture;
+	}
+
+	// the placeholder is bound until the contents are known
+	texture = std::make_shared<Texture>();
+	texture->setType(type);
+	texture->setSources(filenames);
+	texture->setPending(array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+	mPathTextures[path] = texture;
+
+	auto pathKey = mPathKeys.find(path);
+	if (pathKey != mPathKeys.end())
+	{
+		resolve(path, texture, filenames, array, pathKey->second, 1);
+		return texture;
+	}
+
+	// the files are read and hashed on a worker thread
+	std::unique_ptr<Hashing> hashing(new Hashing());
+	hashing->path = path;
+	hashing->texture = texture;
+	hashing->filenames = filenames;
+	hashing->array = array;
+	hashing->type = type;
+	Hashing* task = hashing.get();
+	hashing->done = std::async(std::launch::async, [task]
+	{
+		return contentKey(task->filenames, task->array, task->type, task->key);
+	});
+	mHashing.push_back(std::move(hashing));
+
+	return texture;
+}
+
+void TextureRegistry::update()
+{
+	for (auto hashing = mHashing.begin(); hashing != mHashing.end();)
+	{
+		Hashing& task = **hashing;
+		if (task.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++hashing;
+			continue;
+		}
+
+		if (task.done.get())
+		{
+			resolve(task.path, task.texture, task.filenames, task.array, task.key, task.acquires);
+		}
+		else
+		{
+			for (const std::string& filename : task.filenames)
+				std::cout << "Unable to load: " << filename << std::endl;
+			task.texture->setFailed();
+		}
+		hashing = mHashing.erase(hashing);
+	}
+}
+
+void TextureRegistry::unshare(const std::shared_ptr<Texture>& texture)
+{
+	// the paths of the texture are hashed again when next acquired without a live texture
+	for (const auto& path : mPathTextures)
+	{
+		if (path.second.lock() == texture)
+			mPathKeys.erase(path.first);
+	}
+
+	for (auto entry = mEntries.begin(); entry != mEntries.end(); ++entry)
+	{
+		std::vector<std::shared_ptr<Texture>> aliases;
+		for (const std::weak_ptr<Texture>& alias : entry->second.aliases)
+		{
+			if (std::shared_ptr<Texture> live = alias.lock())
+				aliases.push_back(live);
+		}
+
+		// an alias keeps binding the old contents until its own reload is uploaded
+		auto alias = std::find(aliases.begin(), aliases.end(), texture);
+		if (alias != aliases.end())
+		{
+			aliases.erase(alias);
+			entry->second.aliases.assign(aliases.begin(), aliases.end());
+			entry->second.acquires = std::max(1, entry->second.acquires - 1);
+			return;
+		}
+
+		if (entry->second.texture.lock() != texture)
+			continue;
+
+		if (aliases.empty())
+		{
+			mEntries.erase(entry);
+			return;
+		}
+
+		// the first alias takes over the old contents from its own files, the others alias it
+		std::shared_ptr<Texture> owner = aliases[0];
+		mLoader.reload(owner);
+		for (size_t i = 1; i < aliases.size(); i++)
+			aliases[i]->alias(owner);
+
+		entry->second.texture = owner;
+		entry->second.aliases.assign(aliases.begin() + 1, aliases.end());
+		entry->second.acquires = std::max(1, entry->second.acquires - 1);
+		return;
+	}
+}
+
+void TextureRegistry::resolve(const std::string& path, const std::shared_ptr<Texture>& texture,
+	const std::vector<std::string>& filenames, bool array, uint64_t key, int acquires)
+{
+	mPathKeys[path] = key;
+
+	// identical contents under another path are bound in place of loading them again
+	Entry& entry = mEntries[key];
+	std::shared_ptr<Texture> existing = entry.texture.lock();
+	if (existing)
+	{
+		texture->alias(existing);
+		entry.aliases.push_back(texture);
+		entry.acquires += acquires;
+		mSharedCount += acquires;
+		return;
+	}
+
+	// load a new texture
+	entry.texture = texture;
+	entry.aliases.clear();
+	entry.acquires = acquires;
+	mSharedCount += acquires - 1;
+
+	if (array)
+		mLoader.loadArray(texture, filenames);
+	else
+		mLoader.load(texture, filenames[0]);
+}
+
+void TextureRegistry::prune()
+{
+	for (auto entry = mEntries.begin(); entry != mEntries.end();)
+	{
+		if (entry->second.texture.expired())
+			entry = mEntries.erase(entry);
+		else
+			++entry;
+	}
+
+	for (auto path = mPathTextures.begin(); path != mPathTextures.end();)
+	{
+		if (path->second.expired())
+			path = mPathTextures.erase(path);
+		else
+			++path;
+	}
+}
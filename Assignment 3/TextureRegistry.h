@@ -0,0 +1,89 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Texture.h"
+#include "TextureLoader.h"
+
+/*****************************************************************
+ * shared, reference-counted textures
+ * textures are keyed by file path and by a hash of the file
+ * contents, so loading the same path again returns the existing
+ * texture and identical pixels under another path alias it.
+ * files are hashed on worker threads, a texture binds its
+ * placeholder until its contents are known. a texture is deleted
+ * when its last handle is released
+ *****************************************************************/
+class TextureRegistry
+{
+public:
+	TextureRegistry(TextureLoader& loader);
+
+	// get the texture of an image file, loading it asynchronously if it is not already loaded
+	// if the file cannot be read the texture is marked failed once it has been hashed
+	std::shared_ptr<Texture> acquire(const std::string& filename, Texture::Type type = Texture::Type::Color);
+	// get a 2D texture array of image files, one layer per file in order
+	std::shared_ptr<Texture> acquireArray(const std::vector<std::string>& filenames,
+		Texture::Type type = Texture::Type::Color);
+
+	// share or load textures whose files have been hashed, call once per frame on the GL thread
+	void update();
+	// stop sharing the contents of a texture whose files changed, call before it is reloaded
+	// other paths that aliased it move to one of them, reloaded from its own files
+	void unshare(const std::shared_ptr<Texture>& texture);
+
+	// number of distinct live textures
+	int getTextureCount();
+	// number of acquires answered with an existing texture or its image data
+	int getSharedCount() const;
+	// estimated memory saved by sharing live textures instead of loading duplicates
+	size_t getSavedBytes();
+
+private:
+	// a loaded texture and how many acquires it has served
+	// the textures of other paths with the same contents alias it
+	struct Entry
+	{
+		std::weak_ptr<Texture> texture;
+		std::vector<std::weak_ptr<Texture>> aliases;
+		int acquires = 0;
+	};
+
+	// the files of a path being hashed on a worker thread
+	struct Hashing
+	{
+		std::string path;
+		std::shared_ptr<Texture> texture;
+		std::vector<std::string> filenames;
+		bool array = false;
+		Texture::Type type = Texture::Type::Color;
+		int acquires = 1;
+		uint64_t key = 0;
+		std::future<bool> done;
+	};
+
+	TextureLoader& mLoader;
+	std::map<std::string, uint64_t> mPathKeys;	// path (or joined array paths) to content key
+	std::map<std::string, std::weak_ptr<Texture>> mPathTextures;	// path to the texture handed out for it
+	std::map<uint64_t, Entry> mEntries;			// content key to texture
+	std::vector<std::unique_ptr<Hashing>> mHashing;
+	int mSharedCount = 0;
+
+	// content key of a set of files, returns false if a file cannot be read (safe to call from worker threads)
+	static bool contentKey(const std::vector<std::string>& filenames, bool array, Texture::Type type, uint64_t& key);
+	// find or create the texture for a set of files
+	std::shared_ptr<Texture> acquire(const std::vector<std::string>& filenames, bool array, Texture::Type type);
+	// alias the live texture with the same contents, or load the files if there is none
+	void resolve(const std::string& path, const std::shared_ptr<Texture>& texture, const std::vector<std::string>& filenames,
+		bool array, uint64_t key, int acquires);
+	// drop entries whose texture has been deleted
+	void prune();
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+
+TextureResidency::TextureResidency(TextureLoader& loader) :
+	mLoader(loader)
+{}
+
+void TextureResidency::setBudget(size_t bytes)
+{
+	mBudget = bytes;
+}
+
+size_t TextureResidency::getBudget() const
+{
+	return mBudget;
+}
+
+void TextureResidency::setEvictedSize(int size)
+{
+	mEvictedSize = std::max(1, size);
+}
+
+void TextureResidency::manage(const std::shared_ptr<Texture>& texture)
+{
+	for (const std::weak_ptr<Texture>& managed : mTextures)
+	{
+		if (managed.lock() == texture)
+			return;
+	}
+
+	mTextures.push_back(texture);
+}
+
+void TextureResidency::update()
+{
+	unsigned int frame = Texture::getFrame();
+
+	// take handles to the textures still alive
+	std::vector<std::shared_ptr<Texture>> textures;
+	for (const std::weak_ptr<Texture>& managed : mTextures)
+	{
+		if (std::shared_ptr<Texture> texture = managed.lock())
+			textures.push_back(texture);
+	}
+	mTextures.assign(textures.begin(), textures.end());
+
+	// evicted textures bound this frame are brought back to full resolution
+	// their low resolution mips stay bound until the reload completes
+	for (const std::shared_ptr<Texture>& texture : textures)
+	{
+		if (texture->isEvicted() && texture->isReady() && texture->getLastUsedFrame() == frame)
+			reload(texture);
+	}
+
+	// total estimated memory
+	mResidentBytes = 0;
+	for (const std::shared_ptr<Texture>& texture : textures)
+	{
+		mResidentBytes += texture->getSizeBytes();
+	}
+
+	if (mResidentBytes > mBudget)
+	{
+		// candidates not used this frame, least recently used first
+		std::vector<Texture*> candidates;
+		for (const std::shared_ptr<Texture>& texture : textures)
+		{
+			if (texture->isReady() && !texture->isEvicted() && !texture->getSources().empty()
+				&& texture->getLastUsedFrame() != frame)
+			{
+				candidates.push_back(texture.get());
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Texture* a, const Texture* b)
+		{
+			return a->getLastUsedFrame() < b->getLastUsedFrame();
+		});
+
+		for (Texture* texture : candidates)
+		{
+			if (mResidentBytes <= mBudget)
+				break;
+
+			size_t previousBytes = texture->getSizeBytes();
+			if (texture->evict(mEvictedSize))
+				mResidentBytes = mResidentBytes - previousBytes + texture->getSizeBytes();
+		}
+	}
+
+	mEvictedCount = 0;
+	for (const std::shared_ptr<Texture>& texture : textures)
+	{
+		if (texture->isEvicted())
+			mEvictedCount++;
+	}
+}
+
+int TextureResidency::reloadAll()
+{
+	// aliases follow the texture whose image data they bind
+	int queued = 0;
+	for (const std::weak_ptr<Texture>& managed : mTextures)
+	{
+		std::shared_ptr<Texture> texture = managed.lock();
+		if (texture && texture->isReady() && !texture->isAlias() && !texture->getSources().empty())
+		{
+			reload(texture);
+			queued++;
+		}
+	}
+
+	return queued;
+}
+
+size_t TextureResidency::getResidentBytes() const
+{
+	return mResidentBytes;
+}
+
+int TextureResidency::getEvictedCount() const
+{
+	return mEvictedCount;
+}
+
+void TextureResidency::reload(const std::shared_ptr<Texture>& texture)
+{
+	const std::vector<std::string> sources = texture->getSources();
+
+	if (texture->getTarget() == GL_TEXTURE_2D_ARRAY)
+		mLoader.loadArray(texture, sources);
+	else
+		mLoader.load(texture, sources[0]);
+}
@@ -0,0 +1,54 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <memory>
+#include <vector>
+
+#include "Texture.h"
+#include "TextureLoader.h"
+
+/*****************************************************************
+ * keeps texture memory within a video memory budget
+ * least recently bound textures are reduced to their low
+ * resolution mips and reloaded when they are bound again
+ *****************************************************************/
+class TextureResidency
+{
+public:
+	TextureResidency(TextureLoader& loader);
+
+	// budget in bytes for all managed textures
+	void setBudget(size_t bytes);
+	size_t getBudget() const;
+	// largest width or height kept by evicted textures
+	void setEvictedSize(int size);
+
+	// track a texture until its last handle is released
+	void manage(const std::shared_ptr<Texture>& texture);
+
+	// evict and reload textures, call once per frame after rendering
+	void update();
+	// load every managed texture again from its files, e.g. after the texture quality changed
+	// current contents stay bound until the new levels arrive, textures still loading are left alone
+	// returns the number of textures queued
+	int reloadAll();
+
+	// estimated memory used by managed textures after the last update
+	size_t getResidentBytes() const;
+	// number of managed textures currently evicted
+	int getEvictedCount() const;
+
+private:
+	TextureLoader& mLoader;
+	std::vector<std::weak_ptr<Texture>> mTextures;
+	size_t mBudget = 256 * 1024 * 1024;
+	int mEvictedSize = 64;
+
+	size_t mResidentBytes = 0;
+	int mEvictedCount = 0;
+
+	// queue an evicted texture to be loaded again at full resolution
+	void reload(const std::shared_ptr<Texture>& texture);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "TextureTelemetry.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+namespace
+{
+	// names of the targets and formats textures are created with
+	struct EnumName
+	{
+		GLenum value;
+		const char* name;
+	};
+
+	const EnumName cEnumNames[] =
+	{
+		{ GL_TEXTURE_2D, "GL_TEXTURE_2D" },
+		{ GL_TEXTURE_2D_ARRAY, "GL_TEXTURE_2D_ARRAY" },
+		{ GL_TEXTURE_CUBE_MAP, "GL_TEXTURE_CUBE_MAP" },
+		{ GL_R8, "GL_R8" },
+		{ GL_RG8, "GL_RG8" },
+		{ GL_RGBA8, "GL_RGBA8" },
+		{ GL_COMPRESSED_RGB_S3TC_DXT1_EXT, "GL_COMPRESSED_RGB_S3TC_DXT1_EXT" },
+		{ GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, "GL_COMPRESSED_RGBA_S3TC_DXT5_EXT" },
+		{ GL_COMPRESSED_RG_RGTC2, "GL_COMPRESSED_RG_RGTC2" }
+	};
+
+	// names of the texture qualities in order
+	const char* const cQualityNames[] = { "full", "half", "quarter" };
+
+	// quote a string for JSON, names are file-like so only quotes and backslashes need escaping
+	std::string quoted(const std::string& text)
+	{
+		std::string result = "\"";
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+			result += c;
+		}
+		return result + "\"";
+	}
+}
+
+TextureTelemetry::Totals TextureTelemetry::total(const std::map<std::string, std::shared_ptr<Texture>>& textures)
+{
+	Totals totals;
+	std::set<const Texture*> counted;
+
+	for (const auto& texture : textures)
+	{
+		if (!texture.second || !counted.insert(texture.second.get()).second)
+			continue;
+
+		TextureStats stats = texture.second->getStats();
+		totals.textures++;
+		totals.bytes += stats.bytes;
+		totals.skippedBytes += stats.skippedBytes;
+		totals.decodeMs += stats.decodeMs;
+		totals.mipMs += stats.mipMs;
+		totals.uploadMs += stats.uploadMs;
+	}
+
+	return totals;
+}
+
+std::string TextureTelemetry::enumName(GLenum value)
+{
+	for (const EnumName& entry : cEnumNames)
+	{
+		if (entry.value == value)
+			return entry.name;
+	}
+
+	char hex[16];
+	std::snprintf(hex, sizeof(hex), "0x%04X", value);
+	return hex;
+}
+
+bool TextureTelemetry::dump(const std::string& filename, const std::map<std::string, std::shared_ptr<Texture>>& textures)
+{
+	std::ofstream file(filename, std::ios::out | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cout << "Unable to write texture stats: " << filename << std::endl;
+		return false;
+	}
+
+	// one entry per name, shared textures are listed under each of their names
+	file << "{\n\t\"textures\": [";
+	bool first = true;
+	for (const auto& texture : textures)
+	{
+		if (!texture.second)
+			continue;
+
+		TextureStats stats = texture.second->getStats();
+		file << (first ? "\n" : ",\n");
+		file << "\t\t{ \"name\": " << quoted(texture.first)
+			<< ", \"target\": " << quoted(enumName(stats.target))
+			<< ", \"format\": " << quoted(enumName(stats.internalFormat))
+			<< ", \"compressed\": " << (stats.compressed ? "true" : "false")
+			<< ", \"width\": " << stats.width
+			<< ", \"height\": " << stats.height
+			<< ", \"levels\": " << stats.levels
+			<< ", \"layers\": " << stats.layers
+			<< ", \"bytes\": " << stats.bytes
+			<< ", \"skippedBytes\": " << stats.skippedBytes
+			<< ", \"decodeMs\": " << stats.decodeMs
+			<< ", \"mipMs\": " << stats.mipMs
+			<< ", \"uploadMs\": " << stats.uploadMs << " }";
+		first = false;
+	}
+
+	Totals totals = total(textures);
+	file << "\n\t],\n\t\"quality\": " << quoted(cQualityNames[static_cast<int>(Texture::getQuality())])
+		<< ",\n\t\"totals\": { \"textures\": " << totals.textures
+		<< ", \"bytes\": " << totals.bytes
+		<< ", \"skippedBytes\": " << totals.skippedBytes
+		<< ", \"decodeMs\": " << totals.decodeMs
+		<< ", \"mipMs\": " << totals.mipMs
+		<< ", \"uploadMs\": " << totals.uploadMs << " }\n}\n";
+
+	return static_cast<bool>(file);
+}
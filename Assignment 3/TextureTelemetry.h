@@ -0,0 +1,38 @@
+#ifndef TEXTURE_TELEMETRY_H
+#define TEXTURE_TELEMETRY_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Texture.h"
+
+/*****************************************************************
+ * texture memory and load time reporting
+ * sums the stats of a set of named textures and writes them out
+ * as JSON, so texture budgets can be sized per scene
+ *****************************************************************/
+namespace TextureTelemetry
+{
+	// sums over a set of textures, textures shared under several names are counted once
+	struct Totals
+	{
+		int textures = 0;
+		size_t bytes = 0;
+		size_t skippedBytes = 0;
+		double decodeMs = 0.0;
+		double mipMs = 0.0;
+		double uploadMs = 0.0;
+	};
+
+	Totals total(const std::map<std::string, std::shared_ptr<Texture>>& textures);
+
+	// name of a target or internal format, e.g. "GL_RGBA8", or its value in hex if unknown
+	std::string enumName(GLenum value);
+
+	// write the stats of every texture and the totals to a JSON file
+	// returns false if the file cannot be written
+	bool dump(const std::string& filename, const std::map<std::string, std::shared_ptr<Texture>>& textures);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "TextureUnits.h"
+
+#include <map>
+#include <tuple>
+
+namespace
+{
+	// units and targets whose bindings are remembered
+	const int cNumUnits = 32;
+	const GLenum cTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP };
+	const int cNumTargets = sizeof(cTargets) / sizeof(cTargets[0]);
+
+	// remembered state, ~0u means unknown
+	const GLuint cUnknown = ~0u;
+	GLuint gTextures[cNumUnits][cNumTargets];
+	GLuint gSamplers[cNumUnits];
+	int gActiveUnit = -1;
+	bool gInitialised = false;
+
+	// shared sampler objects
+	typedef std::tuple<GLenum, GLenum, GLenum, GLenum, GLenum> SamplerKey;
+	std::map<SamplerKey, GLuint> gSamplerObjects;
+
+	// counters
+	int gTextureBinds = 0;
+	int gTextureBindsSkipped = 0;
+	int gSamplerBinds = 0;
+	int gSamplerBindsSkipped = 0;
+
+	void initialise()
+	{
+		if (gInitialised)
+			return;
+
+		for (int unit = 0; unit < cNumUnits; unit++)
+		{
+			for (int target = 0; target < cNumTargets; target++)
+				gTextures[unit][target] = cUnknown;
+			gSamplers[unit] = cUnknown;
+		}
+		gInitialised = true;
+	}
+
+	int targetIndex(GLenum target)
+	{
+		for (int i = 0; i < cNumTargets; i++)
+		{
+			if (cTargets[i] == target)
+				return i;
+		}
+		return -1;
+	}
+
+	void activate(int unit)
+	{
+		if (unit != gActiveUnit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			gActiveUnit = unit;
+		}
+	}
+}
+
+GLuint TextureUnits::getSampler(GLenum magFilter, GLenum minFilter, GLenum wrapS, GLenum wrapT, GLenum wrapR)
+{
+	SamplerKey key(magFilter, minFilter, wrapS, wrapT, wrapR);
+	auto found = gSamplerObjects.find(key);
+	if (found != gSamplerObjects.end())
+		return found->second;
+
+	// create a sampler for this combination
+	GLuint sampler;
+	glGenSamplers(1, &sampler);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrapS);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrapT);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, wrapR);
+
+	gSamplerObjects[key] = sampler;
+	return sampler;
+}
+
+void TextureUnits::bindTexture(int unit, GLenum target, GLuint texture)
+{
+	initialise();
+
+	int index = targetIndex(target);
+	if (unit >= 0 && unit < cNumUnits && index >= 0)
+	{
+		if (gTextures[unit][index] == texture)
+		{
+			gTextureBindsSkipped++;
+			return;
+		}
+		gTextures[unit][index] = texture;
+	}
+
+	activate(unit);
+	glBindTexture(target, texture);
+	gTextureBinds++;
+}
+
+void TextureUnits::bindSampler(int unit, GLuint sampler)
+{
+	initialise();
+
+	if (unit >= 0 && unit < cNumUnits)
+	{
+		if (gSamplers[unit] == sampler)
+		{
+			gSamplerBindsSkipped++;
+			return;
+		}
+		gSamplers[unit] = sampler;
+	}
+
+	glBindSampler(unit, sampler);
+	gSamplerBinds++;
+}
+
+void TextureUnits::bindForEdit(GLenum target, GLuint texture)
+{
+	// the active unit is unknown until something is bound through here
+	bindTexture(gActiveUnit >= 0 ? gActiveUnit : 0, target, texture);
+}
+
+void TextureUnits::forgetTexture(GLuint texture)
+{
+	initialise();
+
+	// deleting a texture unbinds it, so a unit holding it now holds 0
+	for (int unit = 0; unit < cNumUnits; unit++)
+	{
+		for (int target = 0; target < cNumTargets; target++)
+		{
+			if (gTextures[unit][target] == texture)
+				gTextures[unit][target] = 0;
+		}
+	}
+}
+
+void TextureUnits::invalidate()
+{
+	gInitialised = false;
+	gActiveUnit = -1;
+	initialise();
+}
+
+int TextureUnits::getTextureBinds()
+{
+	return gTextureBinds;
+}
+
+int TextureUnits::getTextureBindsSkipped()
+{
+	return gTextureBindsSkipped;
+}
+
+int TextureUnits::getSamplerBinds()
+{
+	return gSamplerBinds;
+}
+
+int TextureUnits::getSamplerBindsSkipped()
+{
+	return gSamplerBindsSkipped;
+}
+
+void TextureUnits::resetCounts()
+{
+	gTextureBinds = 0;
+	gTextureBindsSkipped = 0;
+	gSamplerBinds = 0;
+	gSamplerBindsSkipped = 0;
+}
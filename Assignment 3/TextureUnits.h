@@ -0,0 +1,37 @@
+#ifndef TEXTURE_UNITS_H
+#define TEXTURE_UNITS_H
+
+#include <GLEW/glew.h>
+
+/*****************************************************************
+ * texture unit state
+ * shares one sampler object per unique filter/wrap combination
+ * and remembers the textures and samplers bound to each unit so
+ * redundant binds are skipped. all texture binds should go
+ * through here so the remembered state stays correct
+ *****************************************************************/
+namespace TextureUnits
+{
+	// sampler object for a filter/wrap combination, created on first use
+	GLuint getSampler(GLenum magFilter, GLenum minFilter, GLenum wrapS, GLenum wrapT, GLenum wrapR);
+
+	// bind a texture to a unit, skipped if it is already bound
+	void bindTexture(int unit, GLenum target, GLuint texture);
+	// bind a sampler object to a unit (0 uses the texture's own parameters), skipped if already bound
+	void bindSampler(int unit, GLuint sampler);
+	// bind a texture on the active unit to create or modify it
+	void bindForEdit(GLenum target, GLuint texture);
+	// forget a texture that is about to be deleted, its name may be reused
+	void forgetTexture(GLuint texture);
+	// forget all remembered state, call after code that binds textures directly (e.g. the tweak bar)
+	void invalidate();
+
+	// binds issued and skipped since the last reset (reset once per frame)
+	int getTextureBinds();
+	int getTextureBindsSkipped();
+	int getSamplerBinds();
+	int getSamplerBindsSkipped();
+	void resetCounts();
+}
+
+#endif
@@ -0,0 +1,284 @@
+#include "TextureWatcher.h"
+#include "Timing.h"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// split a path into its directory and file name, "./images/a.bmp" gives "images" and "a.bmp"
+	void splitPath(const std::string& path, std::string& directory, std::string& name)
+	{
+		size_t separator = path.find_last_of("/\\");
+		directory = separator == std::string::npos ? "." : path.substr(0, separator);
+		name = separator == std::string::npos ? path : path.substr(separator + 1);
+
+		while (directory.size() > 2 && directory[0] == '.' && (directory[1] == '/' || directory[1] == '\\'))
+			directory = directory.substr(2);
+	}
+
+	// key of a file within a watched directory, file names are not case sensitive on Windows
+	std::string fileKey(const std::string& directory, const std::string& name)
+	{
+		std::string key = directory + "/" + name;
+#ifdef _WIN32
+		std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+		return key;
+	}
+}
+
+#ifdef _WIN32
+struct TextureWatcher::Directory
+{
+	std::string path;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+	OVERLAPPED overlapped = {};
+	DWORD buffer[4096];		// FILE_NOTIFY_INFORMATION records are DWORD aligned
+
+	// queue an asynchronous read of the next changes
+	bool read()
+	{
+		return ReadDirectoryChangesW(handle, buffer, sizeof(buffer), FALSE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr) != FALSE;
+	}
+
+	~Directory()
+	{
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			// wait for the cancelled read before its buffer is freed
+			DWORD bytes = 0;
+			CancelIo(handle);
+			GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+			CloseHandle(handle);
+		}
+		if (overlapped.hEvent)
+			CloseHandle(overlapped.hEvent);
+	}
+};
+#else
+struct TextureWatcher::Directory
+{
+	std::string path;
+	int descriptor = -1;	// inotify watch
+};
+#endif
+
+TextureWatcher::TextureWatcher(TextureLoader& loader) :
+	mLoader(loader)
+{}
+
+TextureWatcher::~TextureWatcher()
+{
+	mDirectories.clear();
+
+#ifndef _WIN32
+	// closing the instance removes its watches
+	if (mNotify >= 0)
+		close(mNotify);
+#endif
+}
+
+void TextureWatcher::watch(const std::shared_ptr<Texture>& texture)
+{
+	const std::vector<std::string>& sources = texture->getSources();
+	if (sources.empty())
+		return;
+
+	for (const std::shared_ptr<Watched>& watched : mWatched)
+	{
+		if (watched->texture.lock() == texture)
+			return;
+	}
+
+	std::shared_ptr<Watched> watched = std::make_shared<Watched>();
+	watched->texture = texture;
+
+	for (const std::string& source : sources)
+	{
+		std::string directory, name;
+		splitPath(source, directory, name);
+		watchDirectory(directory);
+		watched->keys.push_back(fileKey(directory, name));
+	}
+
+	mWatched.push_back(watched);
+}
+
+void TextureWatcher::setChangeCallback(std::function<void(const std::shared_ptr<Texture>&)> callback)
+{
+	mChangeCallback = callback;
+}
+
+void TextureWatcher::watchDirectory(const std::string& path)
+{
+	for (const std::unique_ptr<Directory>& directory : mDirectories)
+	{
+		if (directory->path == path)
+			return;
+	}
+
+	std::unique_ptr<Directory> directory(new Directory());
+	directory->path = path;
+
+#ifdef _WIN32
+	directory->handle = CreateFileA(path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	directory->overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	if (directory->handle == INVALID_HANDLE_VALUE || !directory->overlapped.hEvent || !directory->read())
+	{
+		std::cout << "Unable to watch: " << path << std::endl;
+		return;
+	}
+#else
+	if (mNotify < 0)
+		mNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	// files are reloaded once closed after writing, or when moved into place by editors that save to a temporary file
+	if (mNotify >= 0)
+		directory->descriptor = inotify_add_watch(mNotify, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+	if (directory->descriptor < 0)
+	{
+		std::cout << "Unable to watch: " << path << std::endl;
+		return;
+	}
+#endif
+
+	mDirectories.push_back(std::move(directory));
+}
+
+int TextureWatcher::update()
+{
+	poll();
+
+	// drop textures that have been deleted
+	mWatched.erase(std::remove_if(mWatched.begin(), mWatched.end(), [](const std::shared_ptr<Watched>& watched)
+	{
+		return watched->texture.expired();
+	}), mWatched.end());
+
+	int queued = 0;
+	for (const std::shared_ptr<Watched>& watched : mWatched)
+	{
+		if (!watched->changed || watched->reloading || Timing::elapsedMs(watched->lastChange) < cSettleMs)
+			continue;
+
+		// textures still loading read the new file anyway, changes are picked up after the load otherwise
+		// failed loads are retried, so fixing a broken file replaces the error texture
+		std::shared_ptr<Texture> texture = watched->texture.lock();
+		if (!texture->isReady() && texture->getState() != Texture::State::Failed)
+			continue;
+
+		watched->changed = false;
+		watched->reloading = true;
+
+		if (mChangeCallback)
+			mChangeCallback(texture);
+
+		auto changed = watched->lastChange;
+		mLoader.reload(texture, [this, watched, changed](Texture&, bool success)
+		{
+			watched->reloading = false;
+			if (success)
+			{
+				mReloadCount++;
+				mLastReloadMs = Timing::elapsedMs(changed);
+			}
+		});
+		queued++;
+	}
+
+	return queued;
+}
+
+void TextureWatcher::poll()
+{
+#ifdef _WIN32
+	for (const std::unique_ptr<Directory>& directory : mDirectories)
+	{
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, FALSE))
+			continue;
+
+		// zero bytes means the buffer overflowed and the changes were lost
+		const unsigned char* record = reinterpret_cast<const unsigned char*>(directory->buffer);
+		while (bytes > 0)
+		{
+			const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+			if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED
+				|| info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				int length = static_cast<int>(info->FileNameLength / sizeof(WCHAR));
+				int size = WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, nullptr, 0, nullptr, nullptr);
+				std::string name(size, '\0');
+				WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, &name[0], size, nullptr, nullptr);
+				onChanged(directory->path, name);
+			}
+
+			if (info->NextEntryOffset == 0)
+				break;
+			record += info->NextEntryOffset;
+		}
+
+		ResetEvent(directory->overlapped.hEvent);
+		directory->read();
+	}
+#else
+	if (mNotify < 0)
+		return;
+
+	alignas(inotify_event) char buffer[4096];
+	while (true)
+	{
+		ssize_t length = read(mNotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (char* record = buffer; record < buffer + length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(record);
+			for (const std::unique_ptr<Directory>& directory : mDirectories)
+			{
+				if (event->len > 0 && directory->descriptor == event->wd)
+					onChanged(directory->path, event->name);
+			}
+			record += sizeof(inotify_event) + event->len;
+		}
+	}
+#endif
+}
+
+void TextureWatcher::onChanged(const std::string& directory, const std::string& name)
+{
+	std::string key = fileKey(directory, name);
+	for (const std::shared_ptr<Watched>& watched : mWatched)
+	{
+		if (std::find(watched->keys.begin(), watched->keys.end(), key) != watched->keys.end())
+		{
+			watched->changed = true;
+			watched->lastChange = std::chrono::steady_clock::now();
+		}
+	}
+}
+
+int TextureWatcher::getReloadCount() const
+{
+	return mReloadCount;
+}
+
+double TextureWatcher::getLastReloadMs() const
+{
+	return mLastReloadMs;
+}
@@ -0,0 +1,87 @@
+#ifndef TEXTURE_WATCHER_H
+#define TEXTURE_WATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Texture.h"
+#include "TextureLoader.h"
+
+/*****************************************************************
+ * hot reload of textures whose image files change on disk
+ * the directories of watched textures are monitored with inotify
+ * (ReadDirectoryChangesW on Windows) and polled once per frame,
+ * changed files are decoded again on the loader's worker threads
+ * and the textures are updated in place when their size and
+ * format are unchanged
+ *****************************************************************/
+class TextureWatcher
+{
+public:
+	TextureWatcher(TextureLoader& loader);
+	~TextureWatcher();
+
+	TextureWatcher(const TextureWatcher&) = delete;
+	TextureWatcher& operator=(const TextureWatcher&) = delete;
+
+	// reload a texture when one of its source files changes, until its last handle is released
+	// textures without source files are ignored
+	void watch(const std::shared_ptr<Texture>& texture);
+	// called on the GL thread with each changed texture just before its reload is queued
+	void setChangeCallback(std::function<void(const std::shared_ptr<Texture>&)> callback);
+
+	// read file change notifications and queue reloads, call once per frame on the GL thread
+	// returns the number of reloads queued
+	int update();
+
+	// number of textures reloaded
+	int getReloadCount() const;
+	// milliseconds from the last change being noticed until its texture was updated
+	double getLastReloadMs() const;
+
+private:
+	// a file is reloaded once it has not changed for this long
+	// Windows reports each write while a file is saved, inotify reports it once closed
+#ifdef _WIN32
+	static const int cSettleMs = 20;
+#else
+	static const int cSettleMs = 0;
+#endif
+
+	// a watched directory, platform handles are defined in the source file
+	struct Directory;
+
+	// a watched texture and its source files as directory and file name keys
+	struct Watched
+	{
+		std::weak_ptr<Texture> texture;
+		std::vector<std::string> keys;
+		bool changed = false;	// a source file changed since the last reload was queued
+		bool reloading = false;	// a reload is queued, further changes wait for it
+		std::chrono::steady_clock::time_point lastChange;
+	};
+
+	TextureLoader& mLoader;
+	std::vector<std::unique_ptr<Directory>> mDirectories;
+	std::vector<std::shared_ptr<Watched>> mWatched;	// shared with the callbacks of queued reloads
+	std::function<void(const std::shared_ptr<Texture>&)> mChangeCallback;
+
+	int mReloadCount = 0;
+	double mLastReloadMs = 0.0;
+
+#ifndef _WIN32
+	int mNotify = -1;	// inotify instance
+#endif
+
+	// start watching a directory if it is not already watched
+	void watchDirectory(const std::string& path);
+	// read the change notifications of every watched directory without blocking
+	void poll();
+	// mark the textures using a changed file
+	void onChanged(const std::string& directory, const std::string& name);
+};
+
+#endif
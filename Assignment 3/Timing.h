@@ -0,0 +1,18 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <chrono>
+
+/*****************************************************************
+ * wall clock timing shared by the loaders and benchmarks
+ *****************************************************************/
+namespace Timing
+{
+	// milliseconds since a start time
+	inline double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+#endif
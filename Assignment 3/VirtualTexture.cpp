@@ -0,0 +1,846 @@
+#include "VirtualTexture.h"
+#include "TextureCache.h"
+#include "MipGenerator.h"
+#include "TextureUnits.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "stb_image.h"
+
+namespace
+{
+	// tiled file header, followed by level headers and the pages of every level
+	struct VirtualHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t pageSize;
+		uint32_t border;
+		uint32_t numLevels;
+	};
+
+	struct VirtualLevelHeader
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t pagesX;
+		uint32_t pagesY;
+		uint64_t offset;
+	};
+
+	const char cMagic[4] = { 'V', 'T', 'E', 'X' };
+	const uint32_t cVersion = 2;
+
+	// bytes of one page including its border
+	const size_t cPageBytes = static_cast<size_t>(VirtualTexture::cSlotSize) * VirtualTexture::cSlotSize * 4;
+
+	// pages needed to cover a number of texels
+	int pageCount(int texels)
+	{
+		return std::max(1, (texels + VirtualTexture::cPageSize - 1) / VirtualTexture::cPageSize);
+	}
+
+	// wrap a texel coordinate into [0, size), textures repeat
+	int wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+}
+
+VirtualTexture::VirtualTexture()
+{}
+
+VirtualTexture::~VirtualTexture()
+{
+	if (mTableID != 0)
+	{
+		TextureUnits::forgetTexture(mTableID);
+		glDeleteTextures(1, &mTableID);
+	}
+}
+
+bool VirtualTexture::open(const std::string& filename)
+{
+	// the tiled file is keyed by the source contents and the page layout
+	std::vector<unsigned char> fileData;
+	if (!TextureCache::readFile(filename, fileData))
+		return false;
+
+	uint32_t variant = static_cast<uint32_t>(cPageSize) | (static_cast<uint32_t>(cBorder) << 16);
+	uint64_t key = TextureCache::makeKey(TextureCache::hash(fileData.data(), fileData.size()), variant);
+	std::string path = TextureCache::path(key, "vtx");
+
+	if (mFile.open(path) && parse())
+		return true;
+
+	// cook on a miss or if the file is unreadable
+	mFile.close();
+	if (!cook(filename, path))
+		return false;
+
+	return mFile.open(path) && parse();
+}
+
+int VirtualTexture::getWidth() const
+{
+	return mWidth;
+}
+
+int VirtualTexture::getHeight() const
+{
+	return mHeight;
+}
+
+int VirtualTexture::getLevelCount() const
+{
+	return static_cast<int>(mLevels.size());
+}
+
+int VirtualTexture::getPagesX(int level) const
+{
+	return mLevels[level].pagesX;
+}
+
+int VirtualTexture::getPagesY(int level) const
+{
+	return mLevels[level].pagesY;
+}
+
+const unsigned char* VirtualTexture::getPage(int level, int x, int y) const
+{
+	const Level& source = mLevels[level];
+	return mFile.data() + source.offset + (static_cast<size_t>(y) * source.pagesX + x) * cPageBytes;
+}
+
+int VirtualTexture::getSlot(int level, int x, int y) const
+{
+	const Level& source = mLevels[level];
+	return source.slots[y * source.pagesX + x];
+}
+
+void VirtualTexture::setSlot(int level, int x, int y, int slot)
+{
+	Level& target = mLevels[level];
+	target.slots[y * target.pagesX + x] = slot;
+	mTableDirty = true;
+}
+
+// every page entry points at the finest resident page covering it
+// entries are (slot x, slot y, resident level, valid)
+void VirtualTexture::updateTable(int slotsX)
+{
+	if (!mTableDirty)
+		return;
+
+	bool create = mTableID == 0;
+	if (create)
+		glGenTextures(1, &mTableID);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mTableID);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	std::vector<unsigned char> entries;
+	int numLevels = static_cast<int>(mLevels.size());
+
+	// the table levels must halve like a mip chain, but pages are counted per mip and can round up past half,
+	// so level 0 is a power of two large enough that every level has an entry for each of its pages
+	int tableX = 1;
+	int tableY = 1;
+	while (tableX < mLevels[0].pagesX)
+		tableX *= 2;
+	while (tableY < mLevels[0].pagesY)
+		tableY *= 2;
+
+	for (int level = 0; level < numLevels; level++)
+	{
+		const Level& target = mLevels[level];
+		int tableWidth = std::max(1, tableX >> level);
+		int tableHeight = std::max(1, tableY >> level);
+		entries.assign(static_cast<size_t>(tableWidth) * tableHeight * 4, 0);
+
+		for (int y = 0; y < target.pagesY; y++)
+		{
+			for (int x = 0; x < target.pagesX; x++)
+			{
+				// walk up to coarser levels until a resident page is found
+				for (int parent = level; parent < numLevels; parent++)
+				{
+					const Level& source = mLevels[parent];
+					int shift = parent - level;
+					int slot = getSlot(parent, std::min(x >> shift, source.pagesX - 1), std::min(y >> shift, source.pagesY - 1));
+
+					if (slot >= 0)
+					{
+						unsigned char* entry = &entries[(static_cast<size_t>(y) * tableWidth + x) * 4];
+						entry[0] = static_cast<unsigned char>(slot % slotsX);
+						entry[1] = static_cast<unsigned char>(slot / slotsX);
+						entry[2] = static_cast<unsigned char>(parent);
+						entry[3] = 255;
+						break;
+					}
+				}
+			}
+		}
+
+		if (create)
+		{
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, tableWidth, tableHeight, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+		}
+		else
+		{
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, tableWidth, tableHeight,
+				GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+		}
+	}
+
+	// entries are fetched exactly, never filtered
+	if (create)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	}
+
+	mTableDirty = false;
+}
+
+GLuint VirtualTexture::getTableID() const
+{
+	return mTableID;
+}
+
+// split every mip level into pages with a wrapped border of neighbouring texels
+bool VirtualTexture::cook(const std::string& filename, const std::string& path)
+{
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* imageData = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+
+	if (!imageData)
+		return false;
+
+	std::vector<TextureLevel> mips;
+	MipGenerator::generate(imageData, width, height, MipFilter::Box, true, mips);
+	stbi_image_free(imageData);
+
+	// pages are counted from the size of each mip, levels stop once a single page covers the whole image
+	int numLevels = 1;
+	while (numLevels < static_cast<int>(mips.size())
+		&& (pageCount(mips[numLevels - 1].width) > 1 || pageCount(mips[numLevels - 1].height) > 1))
+	{
+		numLevels++;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+	// write to a temporary file first so a partial write is never loaded
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		std::cerr << "Unable to write virtual texture: " << path << std::endl;
+		return false;
+	}
+
+	VirtualHeader header;
+	std::memcpy(header.magic, cMagic, sizeof(cMagic));
+	header.version = cVersion;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.pageSize = cPageSize;
+	header.border = cBorder;
+	header.numLevels = static_cast<uint32_t>(numLevels);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	// level headers, pages follow in level order
+	uint64_t offset = sizeof(VirtualHeader) + sizeof(VirtualLevelHeader) * numLevels;
+	for (int level = 0; level < numLevels; level++)
+	{
+		VirtualLevelHeader levelHeader;
+		levelHeader.width = static_cast<uint32_t>(mips[level].width);
+		levelHeader.height = static_cast<uint32_t>(mips[level].height);
+		levelHeader.pagesX = static_cast<uint32_t>(pageCount(mips[level].width));
+		levelHeader.pagesY = static_cast<uint32_t>(pageCount(mips[level].height));
+		levelHeader.offset = offset;
+		file.write(reinterpret_cast<const char*>(&levelHeader), sizeof(levelHeader));
+
+		offset += cPageBytes * levelHeader.pagesX * levelHeader.pagesY;
+	}
+
+	std::vector<unsigned char> page(cPageBytes);
+	for (int level = 0; level < numLevels; level++)
+	{
+		const TextureLevel& source = mips[level];
+		int levelPagesX = pageCount(source.width);
+		int levelPagesY = pageCount(source.height);
+
+		for (int py = 0; py < levelPagesY; py++)
+		{
+			for (int px = 0; px < levelPagesX; px++)
+			{
+				for (int ty = 0; ty < cSlotSize; ty++)
+				{
+					int sy = wrap(py * cPageSize + ty - cBorder, source.height);
+					unsigned char* row = &page[static_cast<size_t>(ty) * cSlotSize * 4];
+
+					for (int tx = 0; tx < cSlotSize; tx++)
+					{
+						int sx = wrap(px * cPageSize + tx - cBorder, source.width);
+						std::memcpy(row + tx * 4, &source.data[(static_cast<size_t>(sy) * source.width + sx) * 4], 4);
+					}
+				}
+
+				file.write(reinterpret_cast<const char*>(page.data()), page.size());
+			}
+		}
+	}
+
+	file.close();
+
+	if (!file)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
+
+bool VirtualTexture::parse()
+{
+	const unsigned char* data = mFile.data();
+	size_t size = mFile.size();
+
+	// validate header
+	VirtualHeader header;
+	if (size < sizeof(header))
+		return false;
+
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, cMagic, sizeof(cMagic)) != 0 || header.version != cVersion
+		|| header.pageSize != cPageSize || header.border != cBorder || header.numLevels == 0
+		|| size < sizeof(header) + sizeof(VirtualLevelHeader) * header.numLevels)
+	{
+		return false;
+	}
+
+	mWidth = static_cast<int>(header.width);
+	mHeight = static_cast<int>(header.height);
+	mLevels.resize(header.numLevels);
+
+	for (uint32_t i = 0; i < header.numLevels; i++)
+	{
+		VirtualLevelHeader levelHeader;
+		std::memcpy(&levelHeader, data + sizeof(header) + sizeof(levelHeader) * i, sizeof(levelHeader));
+
+		// every level must be covered by its pages, and every page must lie within the file
+		if (levelHeader.pagesX != static_cast<uint32_t>(pageCount(static_cast<int>(levelHeader.width)))
+			|| levelHeader.pagesY != static_cast<uint32_t>(pageCount(static_cast<int>(levelHeader.height)))
+			|| levelHeader.offset + cPageBytes * levelHeader.pagesX * levelHeader.pagesY > size)
+		{
+			std::cerr << "Corrupt virtual texture file" << std::endl;
+			mLevels.clear();
+			return false;
+		}
+
+		Level& level = mLevels[i];
+		level.width = static_cast<int>(levelHeader.width);
+		level.height = static_cast<int>(levelHeader.height);
+		level.pagesX = static_cast<int>(levelHeader.pagesX);
+		level.pagesY = static_cast<int>(levelHeader.pagesY);
+		level.offset = static_cast<size_t>(levelHeader.offset);
+		level.slots.assign(static_cast<size_t>(level.pagesX) * level.pagesY, -1);
+	}
+
+	mTableDirty = true;
+	return true;
+}
+
+bool VirtualTextureSystem::PageID::operator<(const PageID& other) const
+{
+	if (texture != other.texture)
+		return texture < other.texture;
+	if (level != other.level)
+		return level < other.level;
+	if (y != other.y)
+		return y < other.y;
+	return x < other.x;
+}
+
+VirtualTextureSystem::VirtualTextureSystem()
+{}
+
+VirtualTextureSystem::~VirtualTextureSystem()
+{
+	// stop and join the page reader
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mCondition.notify_all();
+		mThread.join();
+	}
+
+	// delete GL objects
+	if (mCacheID != 0)
+	{
+		TextureUnits::forgetTexture(mCacheID);
+		TextureUnits::forgetTexture(mFeedbackTexture);
+		glDeleteTextures(1, &mCacheID);
+		glDeleteTextures(1, &mFeedbackTexture);
+		glDeleteRenderbuffers(1, &mDepthBuffer);
+		glDeleteFramebuffers(1, &mFramebuffer);
+		glDeleteBuffers(cNumReadbacks, mReadbackPBOs);
+
+		for (GLsync fence : mReadbackFences)
+		{
+			if (fence)
+				glDeleteSync(fence);
+		}
+	}
+}
+
+void VirtualTextureSystem::init(int slots, int feedbackWidth, int feedbackHeight, int feedbackScale)
+{
+	// slot coordinates are stored in 8-bit page table entries
+	mSlotsX = std::min(std::max(slots, 1), 255);
+	mSlots.assign(static_cast<size_t>(mSlotsX) * mSlotsX, Slot());
+	mFeedbackWidth = std::max(feedbackWidth, 1);
+	mFeedbackHeight = std::max(feedbackHeight, 1);
+	mFeedbackBias = std::log2(static_cast<float>(std::max(feedbackScale, 1)));
+
+	// page cache, filtered within a page, borders avoid bleeding between pages
+	int cacheSize = mSlotsX * VirtualTexture::cSlotSize;
+	glGenTextures(1, &mCacheID);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mCacheID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	// feedback buffer, ids are written exactly so no filtering
+	glGenTextures(1, &mFeedbackTexture);
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mFeedbackTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glGenRenderbuffers(1, &mDepthBuffer);
+
+	// feedback is read back through buffers so the CPU never waits on the GPU
+	glGenBuffers(cNumReadbacks, mReadbackPBOs);
+	allocateFeedback();
+
+	GLint framebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mFeedbackTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Virtual texture feedback framebuffer is incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	// start the page reader
+	mThread = std::thread(&VirtualTextureSystem::workerLoop, this);
+}
+
+void VirtualTextureSystem::resize(int feedbackWidth, int feedbackHeight)
+{
+	feedbackWidth = std::max(feedbackWidth, 1);
+	feedbackHeight = std::max(feedbackHeight, 1);
+	if (mCacheID == 0 || (feedbackWidth == mFeedbackWidth && feedbackHeight == mFeedbackHeight))
+		return;
+
+	// feedback in flight has the old size, the next feedback pass requests its pages again
+	for (GLsync& fence : mReadbackFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	// the attachments keep their names, so the framebuffer does not need rebuilding
+	mFeedbackWidth = feedbackWidth;
+	mFeedbackHeight = feedbackHeight;
+	allocateFeedback();
+}
+
+void VirtualTextureSystem::allocateFeedback()
+{
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mFeedbackTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mFeedbackWidth, mFeedbackHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mFeedbackWidth, mFeedbackHeight);
+
+	for (GLuint pbo : mReadbackPBOs)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(mFeedbackWidth) * mFeedbackHeight * 4, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+int VirtualTextureSystem::add(const std::string& filename)
+{
+	// ids are stored in 8 bits, 0 means no texture
+	if (mTextures.size() >= 255)
+		return 0;
+
+	std::unique_ptr<VirtualTexture> texture(new VirtualTexture());
+	if (!texture->open(filename))
+	{
+		std::cout << "Unable to load: " << filename << std::endl;
+		return 0;
+	}
+
+	VirtualTexture* added = texture.get();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTextures.push_back(std::move(texture));
+	}
+	int id = static_cast<int>(mTextures.size());
+
+	// the coarsest level is always resident so every page has a fallback
+	int coarsest = added->getLevelCount() - 1;
+	for (int y = 0; y < added->getPagesY(coarsest); y++)
+	{
+		for (int x = 0; x < added->getPagesX(coarsest); x++)
+		{
+			PageLoad load;
+			load.page = { id, coarsest, x, y };
+			const unsigned char* texels = added->getPage(coarsest, x, y);
+			load.texels.assign(texels, texels + cPageBytes);
+			upload(load, true);
+		}
+	}
+	added->updateTable(mSlotsX);
+
+	return id;
+}
+
+void VirtualTextureSystem::beginFeedback()
+{
+	// save state changed by the feedback pass
+	glGetIntegerv(GL_VIEWPORT, mSavedViewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, mSavedClearColor);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mSavedFramebuffer);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mFeedbackWidth, mFeedbackHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTextureSystem::endFeedback()
+{
+	// copy into the next read back buffer unless it is still in flight
+	if (mReadbackFences[mNextReadback] == nullptr)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackPBOs[mNextReadback]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, mFeedbackWidth, mFeedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		mReadbackFences[mNextReadback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mNextReadback = (mNextReadback + 1) % cNumReadbacks;
+	}
+
+	// restore state
+	glBindFramebuffer(GL_FRAMEBUFFER, mSavedFramebuffer);
+	glViewport(mSavedViewport[0], mSavedViewport[1], mSavedViewport[2], mSavedViewport[3]);
+	glClearColor(mSavedClearColor[0], mSavedClearColor[1], mSavedClearColor[2], mSavedClearColor[3]);
+}
+
+void VirtualTextureSystem::setFeedbackUniforms(ShaderProgram& shader, int id)
+{
+	const VirtualTexture& texture = *mTextures[id - 1];
+
+	shader.setUniform("uVirtualSize", glm::vec2(static_cast<float>(texture.getWidth()), static_cast<float>(texture.getHeight())));
+	shader.setUniform("uLevelCount", static_cast<float>(texture.getLevelCount()));
+	shader.setUniform("uPageSize", static_cast<float>(VirtualTexture::cPageSize));
+	shader.setUniform("uTextureID", static_cast<float>(id));
+	shader.setUniform("uFeedbackBias", mFeedbackBias);
+}
+
+void VirtualTextureSystem::bindPageCache(int unit)
+{
+	// the page cache and page tables use their own texture parameters
+	TextureUnits::bindTexture(unit, GL_TEXTURE_2D, mCacheID);
+	TextureUnits::bindSampler(unit, 0);
+}
+
+void VirtualTextureSystem::bindPageTable(int id, int unit)
+{
+	// 0 is the id of a texture that failed to load
+	if (id <= 0 || id > static_cast<int>(mTextures.size()))
+		return;
+
+	TextureUnits::bindTexture(unit, GL_TEXTURE_2D, mTextures[id - 1]->getTableID());
+	TextureUnits::bindSampler(unit, 0);
+}
+
+void VirtualTextureSystem::setUniforms(ShaderProgram& shader, int id, int cacheUnit, int tableUnit)
+{
+	const VirtualTexture& texture = *mTextures[id - 1];
+	float cacheSize = static_cast<float>(mSlotsX * VirtualTexture::cSlotSize);
+
+	shader.setUniform("uPageCache", cacheUnit);
+	shader.setUniform("uPageTable", tableUnit);
+	shader.setUniform("uVirtualSize", glm::vec2(static_cast<float>(texture.getWidth()), static_cast<float>(texture.getHeight())));
+	shader.setUniform("uLevelCount", static_cast<float>(texture.getLevelCount()));
+	shader.setUniform("uCacheInfo", glm::vec4(static_cast<float>(VirtualTexture::cPageSize), static_cast<float>(VirtualTexture::cBorder), cacheSize, cacheSize));
+}
+
+void VirtualTextureSystem::update(int maxUploads)
+{
+	mFrame++;
+
+	// read back every feedback image the GPU has finished, oldest first
+	std::set<PageID> requests;
+	bool readBack = false;
+
+	for (int i = 0; i < cNumReadbacks; i++)
+	{
+		int index = (mNextReadback + i) % cNumReadbacks;
+		GLsync& fence = mReadbackFences[index];
+		if (fence == nullptr)
+			continue;
+
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+
+		glDeleteSync(fence);
+		fence = nullptr;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackPBOs[index]);
+		const unsigned char* pixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			static_cast<GLsizeiptr>(mFeedbackWidth) * mFeedbackHeight * 4, GL_MAP_READ_BIT));
+
+		if (pixels)
+		{
+			readFeedback(pixels, requests);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			readBack = true;
+		}
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (readBack)
+	{
+		mRequestedPages = static_cast<int>(requests.size());
+		request(requests);
+	}
+
+	// copy pages read from disk into the page cache
+	for (int i = 0; i < maxUploads; i++)
+	{
+		PageLoad load;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mLoaded.empty())
+				break;
+
+			load = std::move(mLoaded.front());
+			mLoaded.pop_front();
+		}
+
+		upload(load, false);
+		mPending.erase(load.page);
+	}
+
+	for (std::unique_ptr<VirtualTexture>& texture : mTextures)
+	{
+		texture->updateTable(mSlotsX);
+	}
+}
+
+int VirtualTextureSystem::getResidentPages() const
+{
+	int resident = 0;
+	for (const Slot& slot : mSlots)
+	{
+		if (slot.used)
+			resident++;
+	}
+
+	return resident;
+}
+
+int VirtualTextureSystem::getRequestedPages() const
+{
+	return mRequestedPages;
+}
+
+int VirtualTextureSystem::getPendingPages()
+{
+	return static_cast<int>(mPending.size());
+}
+
+void VirtualTextureSystem::workerLoop()
+{
+	while (true)
+	{
+		PageID page;
+		const VirtualTexture* texture = nullptr;
+
+		// wait for a page request
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return mStopping || !mReadQueue.empty(); });
+
+			if (mStopping)
+				return;
+
+			page = mReadQueue.front();
+			mReadQueue.pop_front();
+			texture = mTextures[page.texture - 1].get();
+		}
+
+		// copy out of the mapping so disk reads happen on this thread
+		PageLoad load;
+		load.page = page;
+		const unsigned char* texels = texture->getPage(page.level, page.x, page.y);
+		load.texels.assign(texels, texels + cPageBytes);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLoaded.push_back(std::move(load));
+	}
+}
+
+// feedback texels are (page x, page y, level, texture id)
+void VirtualTextureSystem::readFeedback(const unsigned char* pixels, std::set<PageID>& requests)
+{
+	size_t numPixels = static_cast<size_t>(mFeedbackWidth) * mFeedbackHeight;
+	int numTextures = static_cast<int>(mTextures.size());
+
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		const unsigned char* texel = pixels + i * 4;
+		int id = texel[3];
+		if (id == 0 || id > numTextures)
+			continue;
+
+		const VirtualTexture& texture = *mTextures[id - 1];
+		int level = texel[2];
+		if (level >= texture.getLevelCount() || texel[0] >= texture.getPagesX(level) || texel[1] >= texture.getPagesY(level))
+			continue;
+
+		// the coarser pages covering it are needed as fallbacks
+		for (int parent = level; parent < texture.getLevelCount(); parent++)
+		{
+			int shift = parent - level;
+			PageID page = { id, parent, std::min(texel[0] >> shift, texture.getPagesX(parent) - 1),
+				std::min(texel[1] >> shift, texture.getPagesY(parent) - 1) };
+
+			if (!requests.insert(page).second)
+				break;	// parents of this page are already requested
+		}
+	}
+}
+
+void VirtualTextureSystem::request(const std::set<PageID>& requests)
+{
+	std::vector<PageID> missing;
+
+	for (const PageID& page : requests)
+	{
+		int slot = mTextures[page.texture - 1]->getSlot(page.level, page.x, page.y);
+
+		// keep resident pages from being evicted
+		if (slot >= 0)
+			mSlots[slot].lastUsed = mFrame;
+		else if (mPending.count(page) == 0)
+			missing.push_back(page);
+	}
+
+	if (missing.empty())
+		return;
+
+	// coarse pages first, they cover the most of the screen
+	std::stable_sort(missing.begin(), missing.end(), [](const PageID& a, const PageID& b)
+	{
+		return a.level > b.level;
+	});
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const PageID& page : missing)
+		{
+			mReadQueue.push_back(page);
+			mPending.insert(page);
+		}
+	}
+	mCondition.notify_one();
+}
+
+void VirtualTextureSystem::upload(const PageLoad& load, bool pinned)
+{
+	VirtualTexture& texture = *mTextures[load.page.texture - 1];
+	if (texture.getSlot(load.page.level, load.page.x, load.page.y) >= 0)
+		return;
+
+	// drop the page if every slot is pinned or in use, feedback will request it again
+	int slot = allocateSlot();
+	if (slot < 0)
+		return;
+
+	// evict the previous page
+	Slot& target = mSlots[slot];
+	if (target.used)
+		mTextures[target.page.texture - 1]->setSlot(target.page.level, target.page.x, target.page.y, -1);
+
+	int x = (slot % mSlotsX) * VirtualTexture::cSlotSize;
+	int y = (slot / mSlotsX) * VirtualTexture::cSlotSize;
+
+	TextureUnits::bindForEdit(GL_TEXTURE_2D, mCacheID);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VirtualTexture::cSlotSize, VirtualTexture::cSlotSize,
+		GL_RGBA, GL_UNSIGNED_BYTE, load.texels.data());
+
+	target.used = true;
+	target.pinned = pinned;
+	target.page = load.page;
+	target.lastUsed = mFrame;
+	texture.setSlot(load.page.level, load.page.x, load.page.y, slot);
+}
+
+int VirtualTextureSystem::allocateSlot()
+{
+	int leastRecent = -1;
+
+	for (size_t i = 0; i < mSlots.size(); i++)
+	{
+		const Slot& slot = mSlots[i];
+		if (!slot.used)
+			return static_cast<int>(i);
+
+		// pages needed this frame are kept
+		if (slot.pinned || slot.lastUsed == mFrame)
+			continue;
+
+		if (leastRecent < 0 || slot.lastUsed < mSlots[leastRecent].lastUsed)
+			leastRecent = static_cast<int>(i);
+	}
+
+	return leastRecent;
+}
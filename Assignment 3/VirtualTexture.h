@@ -0,0 +1,210 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utilities.h"
+#include "MappedFile.h"
+#include "ShaderProgram.h"
+
+/*****************************************************************
+ * an image cooked into a tiled on-disk file of fixed size pages
+ * per mip level, with a page table describing which pages are
+ * resident in the page cache
+ *****************************************************************/
+class VirtualTexture
+{
+public:
+	// page payload size and the border of neighbouring texels kept around it for filtering
+	static const int cPageSize = 128;
+	static const int cBorder = 4;
+	static const int cSlotSize = cPageSize + 2 * cBorder;
+
+	VirtualTexture();
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// open the tiled file of an image, cooking it on first use
+	bool open(const std::string& filename);
+
+	int getWidth() const;
+	int getHeight() const;
+	int getLevelCount() const;
+	// pages across and down a level
+	int getPagesX(int level) const;
+	int getPagesY(int level) const;
+	// texels of a page including its border, RGBA8 rows bottom-up
+	const unsigned char* getPage(int level, int x, int y) const;
+
+	// page cache slot holding a page, -1 if not resident
+	int getSlot(int level, int x, int y) const;
+	void setSlot(int level, int x, int y, int slot);
+
+	// upload the page table if resident pages changed
+	// slotsX is the number of slots across the page cache
+	void updateTable(int slotsX);
+	GLuint getTableID() const;
+
+private:
+	// a mip level of the tiled file
+	struct Level
+	{
+		int width = 0;
+		int height = 0;
+		int pagesX = 0;
+		int pagesY = 0;
+		size_t offset = 0;			// first page within the file
+		std::vector<int> slots;		// resident slot per page, -1 if not resident
+	};
+
+	MappedFile mFile;
+	int mWidth = 0;
+	int mHeight = 0;
+	std::vector<Level> mLevels;
+
+	// indirection texture, one texel per page per level
+	GLuint mTableID = 0;
+	bool mTableDirty = true;
+
+	// write the tiled file of an image
+	static bool cook(const std::string& filename, const std::string& path);
+	// read the level layout of a mapped tiled file
+	bool parse();
+};
+
+/*****************************************************************
+ * feedback driven virtual texturing
+ * a low resolution feedback pass writes the (page, level) that
+ * each pixel needs, it is read back asynchronously and missing
+ * pages are streamed from disk into a shared page cache texture.
+ * shaders sample through each texture's page table, falling back
+ * to coarser resident pages. only uses OpenGL 3.3 core features
+ * so it runs on software rasterisers such as llvmpipe
+ *****************************************************************/
+class VirtualTextureSystem
+{
+public:
+	VirtualTextureSystem();
+	~VirtualTextureSystem();
+
+	// create the page cache (slots x slots pages) and a feedback buffer of the given size
+	// feedbackScale is how many times smaller the feedback buffer is than the screen
+	void init(int slots, int feedbackWidth, int feedbackHeight, int feedbackScale);
+	// resize the feedback buffer when the window size changes, feedback still being read back is dropped
+	void resize(int feedbackWidth, int feedbackHeight);
+	// add an image file as a virtual texture
+	// returns an id used by the other functions, 0 if the file cannot be loaded
+	int add(const std::string& filename);
+
+	// render the feedback pass between these calls using the feedback shaders
+	void beginFeedback();
+	void endFeedback();
+	// set the feedback shader uniforms for a texture
+	void setFeedbackUniforms(ShaderProgram& shader, int id);
+
+	// bind the page cache, call once per frame after update
+	void bindPageCache(int unit);
+	// bind the page table of a texture, ids of textures that failed to load are ignored
+	void bindPageTable(int id, int unit);
+	// set the sampling uniforms for a texture, the page cache and table units must already be bound
+	void setUniforms(ShaderProgram& shader, int id, int cacheUnit, int tableUnit);
+
+	// read back feedback, stream requested pages and update page tables
+	// maxUploads limits the pages copied into the page cache per call
+	void update(int maxUploads);
+
+	// pages in the page cache
+	int getResidentPages() const;
+	// pages requested by the last feedback read back
+	int getRequestedPages() const;
+	// pages waiting to be read from disk or uploaded
+	int getPendingPages();
+
+private:
+	// a page of a virtual texture
+	struct PageID
+	{
+		int texture;
+		int level;
+		int x;
+		int y;
+
+		bool operator<(const PageID& other) const;
+	};
+
+	// a page read from disk
+	struct PageLoad
+	{
+		PageID page;
+		std::vector<unsigned char> texels;
+	};
+
+	// a page cache slot
+	struct Slot
+	{
+		bool used = false;
+		bool pinned = false;	// coarsest pages are never evicted
+		PageID page = {};
+		unsigned int lastUsed = 0;
+	};
+
+	std::vector<std::unique_ptr<VirtualTexture>> mTextures;
+
+	// page cache
+	GLuint mCacheID = 0;
+	int mSlotsX = 0;
+	std::vector<Slot> mSlots;
+	unsigned int mFrame = 0;
+
+	// feedback buffer and ring of read back buffers
+	static const int cNumReadbacks = 3;
+	GLuint mFramebuffer = 0;
+	GLuint mFeedbackTexture = 0;
+	GLuint mDepthBuffer = 0;
+	GLuint mReadbackPBOs[cNumReadbacks] = {};
+	GLsync mReadbackFences[cNumReadbacks] = {};
+	int mNextReadback = 0;
+	int mFeedbackWidth = 0;
+	int mFeedbackHeight = 0;
+	float mFeedbackBias = 0.0f;
+	GLint mSavedViewport[4] = {};
+	GLfloat mSavedClearColor[4] = {};
+	GLint mSavedFramebuffer = 0;
+
+	// pages requested but not yet in the page cache
+	std::set<PageID> mPending;
+	int mRequestedPages = 0;
+
+	// page reads on a worker thread
+	std::thread mThread;
+	std::deque<PageID> mReadQueue;
+	std::deque<PageLoad> mLoaded;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopping = false;
+
+	// size the feedback texture, depth buffer and read back buffers to the feedback size
+	void allocateFeedback();
+	// worker thread loop
+	void workerLoop();
+	// collect the pages requested by a mapped feedback image
+	void readFeedback(const unsigned char* pixels, std::set<PageID>& requests);
+	// queue pages that are not resident, coarsest first
+	void request(const std::set<PageID>& requests);
+	// copy a page into a free or least recently used slot
+	void upload(const PageLoad& load, bool pinned);
+	// slot for a new page, evicting the least recently used page if the cache is full
+	int allocateSlot();
+};
+
+#endif
@@ -0,0 +1,29 @@
+#version 330 core
+
+// interpolated values from the vertex shaders
+in vec2 vTexCoord;
+
+// uniform input data
+uniform vec2 uVirtualSize;		// virtual texture size in texels
+uniform float uLevelCount;		// levels in the tiled file
+uniform float uPageSize;		// page size in texels
+uniform float uTextureID;		// virtual texture id (1-255)
+uniform float uFeedbackBias;	// log2 of how much smaller the feedback buffer is than the screen
+
+// output data
+out vec4 fColor;
+
+void main()
+{
+	// level from screen-space derivatives, corrected for the smaller feedback buffer
+	vec2 texel = vTexCoord * uVirtualSize;
+	float lod = 0.5f * log2(max(dot(dFdx(texel), dFdx(texel)), dot(dFdy(texel), dFdy(texel)))) - uFeedbackBias;
+	float level = clamp(floor(lod), 0.0f, uLevelCount - 1.0f);
+
+	// page of that level, textures repeat, levels are as large as their mips, whose size rounds down
+	vec2 levelSize = max(floor(uVirtualSize / exp2(level)), 1.0f);
+	vec2 page = floor(fract(vTexCoord) * levelSize / uPageSize);
+
+	// write (page x, page y, level, texture id)
+	fColor = vec4(page, level, uTextureID) / 255.0f;
+}
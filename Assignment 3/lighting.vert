@@ -10,21 +10,44 @@ uniform mat4 uModelViewProjectionMatrix;
 uniform mat4 uModelMatrix;
 uniform mat3 uNormalMatrix;
 
+// quantized vertices: positions and texture coordinates are normalized within their ranges,
+// normals are octahedral encoded in the first two components
+uniform bool uQuantized = false;
+uniform vec3 uPositionMin;
+uniform vec3 uPositionExtent;
+uniform vec2 uTexCoordMin;
+uniform vec2 uTexCoordExtent;
+
 // output data
 out vec3 vPosition;
 out vec3 vNormal;
 out vec2 vTexCoord;
 
+// decode an octahedral encoded unit vector
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += (n.x >= 0.0f) ? -t : t;
+	n.y += (n.y >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
 void main()
 {
+	// decode quantized attributes
+	vec3 position = uQuantized ? uPositionMin + aPosition * uPositionExtent : aPosition;
+	vec3 normal = uQuantized ? octahedralDecode(aNormal.xy) : aNormal;
+	vec2 texCoord = uQuantized ? uTexCoordMin + aTexCoord * uTexCoordExtent : aTexCoord;
+
 	// set vertex position
-    gl_Position = uModelViewProjectionMatrix * vec4(aPosition, 1.0f);
+    gl_Position = uModelViewProjectionMatrix * vec4(position, 1.0f);
 
 	// set vertex shader output
 	// will be interpolated for each fragment
-	vPosition = (uModelMatrix * vec4(aPosition, 1.0f)).xyz;
-	vNormal = uNormalMatrix * aNormal;
+	vPosition = (uModelMatrix * vec4(position, 1.0f)).xyz;
+	vNormal = uNormalMatrix * normal;
 
 	// interpolate texture coordinate
-	vTexCoord = aTexCoord;
+	vTexCoord = texCoord;
 }
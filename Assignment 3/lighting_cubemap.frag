@@ -28,11 +28,26 @@ uniform vec3 uViewpoint;
 uniform Light uLight;
 uniform Material uMaterial;
 uniform samplerCube uEnvironmentMap;
+uniform float uEnvironmentLod;	// prefiltered level matching the material's shininess
 uniform float uReflection;
 
+// diffuse environment lighting
+uniform bool uEnvironmentLighting;	// ambient from the environment instead of the light
+uniform vec3 uIrradiance[9];		// spherical harmonic irradiance divided by pi
+
 // output data
 out vec3 fColor;
 
+// ambient radiance reflected by a Lambertian surface facing n
+vec3 irradiance(vec3 n)
+{
+	return uIrradiance[0] * 0.282095f
+		+ uIrradiance[1] * (0.488603f * n.y) + uIrradiance[2] * (0.488603f * n.z) + uIrradiance[3] * (0.488603f * n.x)
+		+ uIrradiance[4] * (1.092548f * n.x * n.y) + uIrradiance[5] * (1.092548f * n.y * n.z)
+		+ uIrradiance[6] * (0.315392f * (3.0f * n.z * n.z - 1.0f))
+		+ uIrradiance[7] * (1.092548f * n.x * n.z) + uIrradiance[8] * (0.546274f * (n.x * n.x - n.y * n.y));
+}
+
 void main()
 {
 	// fragment normal
@@ -48,7 +63,7 @@ void main()
 	vec3 h = normalize(l + v);
 
 	// calculate ambient, diffuse and specular intensities
-	vec3 Ia = uLight.La * uMaterial.Ka;
+	vec3 Ia = (uEnvironmentLighting ? irradiance(n) : uLight.La) * uMaterial.Ka;
 	vec3 Id = vec3(0.0f);
 	vec3 Is = vec3(0.0f);
 	float dotLN = max(dot(l, n), 0.0f);
@@ -71,6 +86,6 @@ void main()
 	
 	// modulate with environment map reflection
 	// takes uReflection and will output fColor or the texture() * fColor depending on the uReflection value
-	fColor = mix(fColor, (fColor * texture(uEnvironmentMap, reflectEnvMap).rgb), uReflection);
+	fColor = mix(fColor, (fColor * textureLod(uEnvironmentMap, reflectEnvMap, uEnvironmentLod).rgb), uReflection);
 
 }
\ No newline at end of file
@@ -29,11 +29,58 @@ uniform vec3 uViewpoint;
 uniform Light uLight;
 uniform Material uMaterial;
 uniform float uAlpha;
-uniform sampler2D uTextureSampler;
+uniform sampler2DArray uTextureSampler;
+uniform int uTextureLayer;
+
+// diffuse environment lighting
+uniform bool uEnvironmentLighting;	// ambient from the environment instead of the light
+uniform vec3 uIrradiance[9];		// spherical harmonic irradiance divided by pi
+
+// virtual texturing
+uniform bool uVirtual;			// sample colour through the page table
+uniform sampler2D uPageCache;	// resident pages
+uniform sampler2D uPageTable;	// page table, one level per mip level
+uniform vec2 uVirtualSize;		// virtual texture size in texels
+uniform float uLevelCount;		// levels in the page table
+uniform vec4 uCacheInfo;		// page size, border, page cache width and height
 
 // output data
 out vec4 fColor;
 
+// ambient radiance reflected by a Lambertian surface facing n
+vec3 irradiance(vec3 n)
+{
+	return uIrradiance[0] * 0.282095f
+		+ uIrradiance[1] * (0.488603f * n.y) + uIrradiance[2] * (0.488603f * n.z) + uIrradiance[3] * (0.488603f * n.x)
+		+ uIrradiance[4] * (1.092548f * n.x * n.y) + uIrradiance[5] * (1.092548f * n.y * n.z)
+		+ uIrradiance[6] * (0.315392f * (3.0f * n.z * n.z - 1.0f))
+		+ uIrradiance[7] * (1.092548f * n.x * n.z) + uIrradiance[8] * (0.546274f * (n.x * n.x - n.y * n.y));
+}
+
+// sample a virtual texture through its page table
+// the level is chosen as in the feedback pass, missing pages fall back to coarser resident pages
+vec3 sampleVirtual(vec2 texCoord)
+{
+	vec2 texel = texCoord * uVirtualSize;
+	float lod = 0.5f * log2(max(dot(dFdx(texel), dFdx(texel)), dot(dFdy(texel), dFdy(texel))));
+	int level = int(clamp(floor(lod), 0.0f, uLevelCount - 1.0f));
+
+	// page table entry: slot x, slot y, resident level
+	float pageSize = uCacheInfo.x;
+	float border = uCacheInfo.y;
+	// each level is as large as its mip, whose size rounds down
+	vec2 levelTexel = fract(texCoord) * max(floor(uVirtualSize / exp2(float(level))), 1.0f);
+	ivec2 page = min(ivec2(levelTexel / pageSize), textureSize(uPageTable, level) - 1);
+	vec3 entry = texelFetch(uPageTable, page, level).xyz * 255.0f;
+
+	// position within the resident page
+	vec2 residentTexel = fract(texCoord) * max(floor(uVirtualSize / exp2(entry.z)), 1.0f);
+	vec2 pageTexel = mod(residentTexel, pageSize);
+
+	vec2 cacheTexel = entry.xy * (pageSize + 2.0f * border) + border + pageTexel;
+	return textureLod(uPageCache, cacheTexel / uCacheInfo.zw, 0.0f).rgb;
+}
+
 void main()
 {
 	// fragment normal
@@ -49,7 +96,7 @@ void main()
 	vec3 h = normalize(l + v);
 
 	// calculate ambient, diffuse and specular intensities
-	vec3 Ia = uLight.La * uMaterial.Ka;
+	vec3 Ia = (uEnvironmentLighting ? irradiance(n) : uLight.La) * uMaterial.Ka;
 	vec3 Id = vec3(0.0f);
 	vec3 Is = vec3(0.0f);
 	float dotLN = max(dot(l, n), 0.0f);
@@ -68,7 +115,8 @@ void main()
 	fColor = vec4(Ia + Id + Is, uAlpha);
 
 	// applies texture with alpha value
-	fColor *= vec4(texture(uTextureSampler, vTexCoord).rgb, uAlpha); 
+	vec3 textureColor = uVirtual ? sampleVirtual(vTexCoord) : texture(uTextureSampler, vec3(vTexCoord, uTextureLayer)).rgb;
+	fColor *= vec4(textureColor, uAlpha); 
 	
 	
 }
@@ -54,6 +54,24 @@ struct VertexNormTanTex
 	GLfloat texCoord[2];
 };
 
+// quantized formats, decoded in lighting.vert and cubeLighting.vert
+// positions are 16-bit normalized within the mesh bounds (the fourth component pads to 4 bytes)
+// normals are octahedral encoded as two 16-bit signed normalized values
+// SimpleModel meshes carry no tangents, so there is no quantized form of VertexNormTanTex
+struct VertexQuantizedNormal
+{
+	GLushort position[4];
+	GLshort normal[2];
+};
+
+// texture coordinates are 16-bit normalized within their range
+struct VertexQuantizedNormTex
+{
+	GLushort position[4];
+	GLshort normal[2];
+	GLushort texCoord[2];
+};
+
 // light properties
 struct Light
 {
@@ -134,6 +152,8 @@ struct Material
 	glm::vec3 Ks;		// specular reflection coefficient
 	glm::vec3 emission;	// light source emission component (point light/spotlight)
 	float shininess;	// specular reflection shininess exponent
+	int textureLayer = 0;	// colour layer within the material's texture array
+	int normalLayer = 0;	// layer within the material's normal map array
 };
 
 